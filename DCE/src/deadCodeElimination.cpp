@@ -3,25 +3,66 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
-//#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
-#include "dataflow.h"
+#include "control-dependence.h"
+#include "dom-tree.h"
+#include "pass-stats.h"
+#include "static-dataflow.h"
+
+#define DEBUG_TYPE "dead-code-elimination"
 
 using namespace llvm;
 using namespace std;
 
+STATISTIC(NumDeleted, "Number of faint instructions deleted");
+STATISTIC(NumBranchesRemoved, "Number of dead branches removed");
+STATISTIC(NumBlocksDeleted, "Number of dead blocks deleted");
+STATISTIC(NumStoresDeleted, "Number of dead stores deleted");
+STATISTIC(NumAllocasDeleted, "Number of unused allocas deleted");
+
 namespace {
 
+// enum to denote the analysis used to find dead instructions
+enum dceMode {
+  FAINT_MODE = 0,   // Faint variables, as a bit-vector dataflow analysis
+  SSA_MODE = 1,     // Liveness along SSA use-def chains, with a worklist
+  COMPARE_MODE = 2, // Both, reporting the time and result of each
+  AGGRESSIVE_MODE = 3, // Branches are dead too, unless control depended on
+};
+
+static cl::opt<enum dceMode> DCEMode(
+    "dce-mode", cl::desc("Analysis used by the dead code elimination pass"),
+    cl::init(SSA_MODE),
+    cl::values(clEnumValN(FAINT_MODE, "faint",
+                          "Faint variables, as a dataflow analysis"),
+               clEnumValN(SSA_MODE, "ssa",
+                          "Liveness along SSA use-def chains"),
+               clEnumValN(COMPARE_MODE, "compare",
+                          "Both, reporting the time taken by each"),
+               clEnumValN(AGGRESSIVE_MODE, "aggressive",
+                          "SSA liveness, removing dead branches and blocks")));
+
+static cl::opt<bool> DeadStores(
+    "dce-dead-stores",
+    cl::desc("Delete the dead stores to local allocas, and unused allocas"),
+    cl::init(true));
+
 class DeadCodeElimination : public FunctionPass {
 public:
   static char ID;
-  DeadCodeElimination() : FunctionPass(ID) {}
+  DeadCodeElimination() : FunctionPass(ID), postDomTree(true) {}
 
   bool isLive(Instruction *I) {
     return (I->isTerminator() || isa<DbgInfoIntrinsic>(I) ||
@@ -29,97 +70,649 @@ public:
   }
 
   virtual bool runOnFunction(Function &F) {
+    PassStats stats("dead-code-elimination", F);
+
+    // Stores are live roots of every mode, so the dead ones are deleted first,
+    // and the values they stored can then be found dead too.
+    unsigned storesDeleted = 0;
+    if (DeadStores)
+      storesDeleted = eliminateDeadStores(F, stats);
+
+    if (DCEMode == FAINT_MODE) {
+      vector<Instruction *> faint;
+      unsigned deleted = 0;
+      // Results that are not a fixed point may under-approximate liveness, so
+      // nothing is removed then.
+      if (findFaint(F, stats, faint)) {
+        deleted = eliminateDeadCode(faint);
+        stats.addTransform("deleted", deleted);
+      }
+      return storesDeleted + deleted > 0;
+    }
 
-    // set up the domain
-    setupDomain(F);
-
-    // intialize gen and kill set for each basic block
-    populateInfoMap(F);
-
-    // Sets the boundary and init conditions, which is
-    // the set of all variables
-    BitVector boundaryCond(domain.size(), true);
-    BitVector initCond(domain.size(), true);
-
-    // create a new DCE analysis variable
-    DeadCodeEliminationAnalysis *dce = new DeadCodeEliminationAnalysis(
-        domain.size(), BACKWARD, boundaryCond, initCond);
-    // Run the Dataflow pass
-    dce->run(F, infoMap);
-
-    // This function eliminates the dead code
-    eliminateDeadCode(F, dce->result);
+    SmallPtrSet<Instruction *, 32> live;
+    if (DCEMode == AGGRESSIVE_MODE) {
+      markLiveAggressive(F, live);
+      unsigned removed = removeDeadBranches(F, live);
+      unsigned deleted = sweepDeadCode(F, live);
+      unsigned blocks = removeUnreachableBlocks(F);
+      stats.addTransform("deleted", deleted);
+      stats.addTransform("branches_removed", removed);
+      stats.addTransform("blocks_deleted", blocks);
+      return storesDeleted + deleted + removed + blocks > 0;
+    }
 
-    return false;
+    if (DCEMode == COMPARE_MODE) {
+      compareModes(F, live);
+    } else {
+      markLive(F, live);
+    }
+    unsigned deleted = sweepDeadCode(F, live);
+    stats.addTransform("deleted", deleted);
+    return storesDeleted + deleted > 0;
   }
 
   virtual void getAnalysisUsage(AnalysisUsage &AU) const {
-    AU.setPreservesAll();
+    // The aggressive mode changes the CFG.
+    if (DCEMode != AGGRESSIVE_MODE)
+      AU.setPreservesAll();
     AU.addRequired<LoopInfoWrapperPass>();
   }
 
 private:
+  DomTree postDomTree;           // Post-dominator tree, for the aggressive mode
+  ControlDependence controlDeps; // Control dependences, from postDomTree
+  vector<bool> liveBlocks;       // Blocks by post-dominator tree ID
+
   map<BasicBlock *, struct bbInfo *> infoMap;
-  map<Instruction *, int> domainToBitMap;
-  map<int, Instruction *> bitToDomainMap;
+  // Position of each instruction of the domain in the BitVectors, and the
+  // instructions by position.
+  DenseMap<Instruction *, int> domainToBitMap;
   vector<Instruction *> domain;
 
-  void eliminateDeadCode(Function &F,
-                         map<BasicBlock *, struct bbProps *> result) {
+  // Local allocas whose address does not escape, by position in the
+  // BitVectors of the dead store analysis, and the position of the alloca each
+  // pointer derived from one of them points into.
+  vector<AllocaInst *> allocas;
+  DenseMap<Value *, int> pointerToAlloca;
+
+  /* Runs the faint variable analysis on F, and collects the faint
+   * instructions, in the order they are to be deleted. Returns false if the
+   * analysis did not converge.
+   *
+   * The kill sets are built from the uses of each value, but a use by a
+   * faint instruction does not make a value live. The walk of each block
+   * already ignores them within the block, but a chain that spans blocks is
+   * only found one link at a time, so the analysis is run again with the uses
+   * by the instructions found faint left out of the kill sets, until no more
+   * instructions are found faint.
+   */
+  bool findFaint(Function &F, PassStats &stats,
+                 vector<Instruction *> &faint) {
+    // set up the domain
+    setupDomain(F);
+
+    // Sets the boundary and init conditions, which is
+    // the set of all variables
+    BitVector boundaryCond(domain.size(), true);
+    BitVector initCond(domain.size(), true);
+
+    SmallPtrSet<Instruction *, 32> knownFaint;
+    while (true) {
+      // intialize gen and kill set for each basic block
+      populateInfoMap(F, knownFaint);
+
+      // Run the Dataflow pass
+      DeadCodeEliminationAnalysis dce(domain.size(), boundaryCond, initCond);
+      dce.run(F, infoMap);
+      stats.addAnalysis(dce);
+
+      if (!dce.hasConverged())
+        return false;
+      faint.clear();
+      collectFaint(F, dce.result, knownFaint, faint);
+
+      // With fewer kills, the faint instructions of a run are a superset of
+      // the ones of the previous run, so it is done when none are new.
+      if (faint.size() == knownFaint.size())
+        break;
+      knownFaint.insert(faint.begin(), faint.end());
+    }
+
+    collectDeadPhiCycles(F, faint);
+    return true;
+  }
+
+  // Collects the faint instructions of each block, walking it backwards.
+  void collectFaint(Function &F, map<BasicBlock *, struct bbProps *> &result,
+                    const SmallPtrSetImpl<Instruction *> &knownFaint,
+                    vector<Instruction *> &insToDel) {
     for (Function::iterator itr = F.begin(); itr != F.end(); ++itr) {
       BasicBlock *blk = dyn_cast<BasicBlock>(&*itr);
-
-      // check the faint value for this basic block
-      BitVector faintVal = result[blk]->bbInput;
-      // store instructions to delete
-      vector<Instruction *> insToDel;
+      // unreachable blocks are not analysed
+      if (!result.count(blk))
+        continue;
+
+      // check the faint values at the end of this basic block, and walk
+      // the block backwards to find the faint values after each instruction
+      BitVector faintVal = result[blk]->bbOutput;
+      SmallVector<int, 8> uses;
+      collectEdgeUses(blk, knownFaint, uses);
+      for (int use : uses)
+        faintVal.reset(use);
 
       for (BasicBlock::reverse_iterator rItr = itr->rbegin();
            rItr != itr->rend(); ++rItr) {
         Instruction *I = &(*rItr);
+        bool faint = false;
 
         // we do not need live instructions
-        if (isLive(I))
+        if (!isLive(I)) {
+          auto foundInDomain = domainToBitMap.find(I);
+          if (foundInDomain != domainToBitMap.end()) {
+            faint = faintVal[foundInDomain->second];
+            if (faint) {
+              insToDel.push_back(I);
+            }
+            // the value is faint above its definition
+            faintVal.set(foundInDomain->second);
+          }
+        }
+
+        // a faint instruction does not make its operands live, and a Phi
+        // uses them in its predecessors
+        if (faint || isa<PHINode>(I))
           continue;
+        for (unsigned operands = 0; operands < I->getNumOperands(); ++operands) {
+          auto foundInDomain =
+              domainToBitMap.find(dyn_cast<Instruction>(I->getOperand(operands)));
+          if (foundInDomain != domainToBitMap.end()) {
+            faintVal.reset(foundInDomain->second);
+          }
+        }
+      }
+    }
+  }
 
-        // store all instructions
-        auto foundInDomain = find(domain.begin(), domain.end(), I);
-        if (foundInDomain != domain.end()) {
-          int instructionIdx = domainToBitMap[I];
-          if (faintVal[instructionIdx]) {
-            insToDel.push_back(I);
+  /* In the faint analysis, each use in a cycle of Phis and instructions that
+   * only feed each other keeps the previous one from being faint, so such a
+   * cycle is never faint. A Phi is dead, with every instruction that uses it, if
+   * following its users never reaches a live instruction. Phis found to reach
+   * one are remembered, so that other cycles can stop there.
+   */
+  void collectDeadPhiCycles(Function &F, vector<Instruction *> &dead) {
+    SmallPtrSet<Instruction *, 32> isDead;
+    isDead.insert(dead.begin(), dead.end());
+    SmallPtrSet<Instruction *, 32> needed;
+
+    for (Instruction &I : instructions(F)) {
+      PHINode *phi = dyn_cast<PHINode>(&I);
+      if (!phi || isDead.count(phi) || needed.count(phi))
+        continue;
+
+      SmallVector<Instruction *, 16> closure;
+      SmallPtrSet<Instruction *, 16> seen;
+      closure.push_back(phi);
+      seen.insert(phi);
+      bool live = false;
+      for (unsigned pos = 0; pos < closure.size() && !live; ++pos) {
+        for (User *U : closure[pos]->users()) {
+          Instruction *user = cast<Instruction>(U);
+          if (isDead.count(user))
+            continue;
+          if (isLive(user) || needed.count(user)) {
+            live = true;
+            break;
           }
+          if (seen.insert(user).second)
+            closure.push_back(user);
+        }
+      }
+
+      if (live) {
+        needed.insert(phi);
+        continue;
+      }
+      for (Instruction *member : closure) {
+        isDead.insert(member);
+        dead.push_back(member);
+      }
+    }
+  }
+
+  /* Deletes the faint instructions, and returns how many were deleted. A
+   * faint instruction is only used by other faint instructions, so whole
+   * chains are deleted at once: every use is replaced first, and the
+   * instructions are erased at the end.
+   */
+  unsigned eliminateDeadCode(vector<Instruction *> &insToDel) {
+    for (auto ins : insToDel) {
+      errs() << "Instruction deleted: " << *(Value *)&*ins << "\n";
+    }
+    for (auto ins : insToDel) {
+      ins->replaceAllUsesWith(UndefValue::get(ins->getType()));
+    }
+    // delete the instruction from code
+    for (auto ins : insToDel) {
+      ins->eraseFromParent();
+      ++NumDeleted;
+    }
+    return insToDel.size();
+  }
+
+  /* Marks the live instructions of F. Since F is in SSA form, liveness only
+   * flows from an instruction to the definitions of its operands, so the roots
+   * given by isLive are propagated backwards along use-def chains with a
+   * worklist. Each instruction is marked and visited at most once, so this
+   * runs in O(instructions + uses).
+   */
+  void markLive(Function &F, SmallPtrSetImpl<Instruction *> &live) {
+    SmallVector<Instruction *, 64> worklist;
+    for (Instruction &I : instructions(F)) {
+      if (isLive(&I) && live.insert(&I).second)
+        worklist.push_back(&I);
+    }
+
+    while (!worklist.empty()) {
+      Instruction *I = worklist.pop_back_val();
+      for (Use &op : I->operands()) {
+        Instruction *def = dyn_cast<Instruction>(op.get());
+        if (def && live.insert(def).second)
+          worklist.push_back(def);
+      }
+    }
+  }
+
+  /* Marks the live instructions of F, assuming that conditional branches are
+   * dead until proven live. The roots are the instructions isLive keeps,
+   * except for branches, and liveness is propagated along use-def chains as
+   * in markLive. In addition, once a block holds a live instruction, the
+   * branches it is control dependent on are live, since they decide whether
+   * it runs. A live Phi needs to know which edge control came from, so the
+   * incoming blocks are treated the same way. Branches in blocks that cannot
+   * reach an exit are kept, so that infinite loops are not removed.
+   */
+  void markLiveAggressive(Function &F, SmallPtrSetImpl<Instruction *> &live) {
+    postDomTree.recalculate(F);
+    controlDeps.recalculate(postDomTree);
+    liveBlocks.assign(postDomTree.size(), false);
+
+    // Blocks that can reach an exit, walking backwards from the exits.
+    SmallPtrSet<BasicBlock *, 32> reachesExit;
+    SmallVector<BasicBlock *, 32> blockStack;
+    for (BasicBlock &BB : F) {
+      if (succ_empty(&BB) && reachesExit.insert(&BB).second)
+        blockStack.push_back(&BB);
+    }
+    while (!blockStack.empty()) {
+      BasicBlock *BB = blockStack.pop_back_val();
+      for (BasicBlock *pred : predecessors(BB)) {
+        if (reachesExit.insert(pred).second)
+          blockStack.push_back(pred);
+      }
+    }
+
+    SmallVector<Instruction *, 64> worklist;
+    for (Instruction &I : instructions(F)) {
+      bool root = isa<BranchInst>(&I) ? !reachesExit.count(I.getParent())
+                                      : isLive(&I);
+      if (root)
+        markInstructionLive(&I, live, worklist);
+    }
+    propagateLive(live, worklist);
+  }
+
+  // Marks live everything the instructions on the worklist need.
+  void propagateLive(SmallPtrSetImpl<Instruction *> &live,
+                     SmallVectorImpl<Instruction *> &worklist) {
+    while (!worklist.empty()) {
+      Instruction *I = worklist.pop_back_val();
+      for (Use &op : I->operands()) {
+        if (Instruction *def = dyn_cast<Instruction>(op.get()))
+          markInstructionLive(def, live, worklist);
+      }
+      if (PHINode *phi = dyn_cast<PHINode>(I)) {
+        for (BasicBlock *incoming : phi->blocks()) {
+          markBlockLive(incoming, live, worklist);
+        }
+      }
+    }
+  }
+
+  void markInstructionLive(Instruction *I, SmallPtrSetImpl<Instruction *> &live,
+                           SmallVectorImpl<Instruction *> &worklist) {
+    if (!live.insert(I).second)
+      return;
+    worklist.push_back(I);
+    markBlockLive(I->getParent(), live, worklist);
+  }
+
+  // Marks BB live, and the branches it is control dependent on with it.
+  void markBlockLive(BasicBlock *BB, SmallPtrSetImpl<Instruction *> &live,
+                     SmallVectorImpl<Instruction *> &worklist) {
+    int id = postDomTree.getBlockId(BB);
+    if (liveBlocks[id])
+      return;
+    liveBlocks[id] = true;
+    for (int branch : controlDeps.dependsOn(id)) {
+      markInstructionLive(postDomTree.getBlock(branch)->getTerminator(), live,
+                          worklist);
+    }
+  }
+
+  /* Rewrites each dead conditional branch to jump to its nearest live
+   * post-dominator. The blocks in between hold no live instruction, or they
+   * would be control dependent on the branch, and they are left unreachable.
+   * Every terminator that remains is made live, so that the sweep keeps it.
+   * Returns the number of branches removed.
+   */
+  unsigned removeDeadBranches(Function &F, SmallPtrSetImpl<Instruction *> &live) {
+    unsigned removed = 0;
+    for (BasicBlock &BB : F) {
+      BranchInst *branch = dyn_cast<BranchInst>(BB.getTerminator());
+      if (!branch || branch->isUnconditional() || live.count(branch)) {
+        live.insert(BB.getTerminator());
+        continue;
+      }
+
+      int id = postDomTree.getIdom(postDomTree.getBlockId(&BB));
+      while (id > 0 && !liveBlocks[id])
+        id = postDomTree.getIdom(id);
+      if (id <= 0) {
+        // Only the virtual exit post-dominates it, so keep the branch.
+        SmallVector<Instruction *, 8> worklist;
+        markInstructionLive(branch, live, worklist);
+        propagateLive(live, worklist);
+        continue;
+      }
+      BasicBlock *target = postDomTree.getBlock(id);
+
+      // Phis of the old successors no longer have an incoming edge from BB,
+      // except for one edge to the target.
+      bool kept = false;
+      for (BasicBlock *succ : successors(&BB)) {
+        if (succ == target && !kept)
+          kept = true;
+        else
+          succ->removePredecessor(&BB, true);
+      }
+      live.insert(BranchInst::Create(target, branch));
+      branch->eraseFromParent();
+      ++NumBranchesRemoved;
+      ++removed;
+    }
+    return removed;
+  }
+
+  // Deletes the blocks of F that are no longer reachable, and returns how many
+  // were deleted.
+  unsigned removeUnreachableBlocks(Function &F) {
+    unsigned before = F.size();
+    EliminateUnreachableBlocks(F, nullptr, true);
+    NumBlocksDeleted += before - F.size();
+    return before - F.size();
+  }
+
+  /* Deletes every instruction of F that is not live, in a single pass. Dead
+   * instructions are only used by other dead instructions, so their
+   * references are dropped before any of them is erased.
+   */
+  unsigned sweepDeadCode(Function &F, SmallPtrSetImpl<Instruction *> &live) {
+    vector<Instruction *> dead;
+    for (Instruction &I : instructions(F)) {
+      if (!live.count(&I)) {
+        errs() << "Instruction deleted: " << I << "\n";
+        dead.push_back(&I);
+      }
+    }
+    for (Instruction *I : dead) {
+      I->dropAllReferences();
+    }
+    for (Instruction *I : dead) {
+      I->eraseFromParent();
+      ++NumDeleted;
+    }
+    return dead.size();
+  }
+
+  /* Runs both analyses on F, before anything is deleted, and reports the time
+   * each of them took, and the number of dead instructions it found. Each
+   * analysis also gets a statistics record of its own. The liveness found by
+   * the SSA analysis is returned in live.
+   */
+  void compareModes(Function &F, SmallPtrSetImpl<Instruction *> &live) {
+    vector<Instruction *> faint;
+    double faintTime, ssaTime;
+    bool converged;
+    {
+      PassStats faintStats("dead-code-elimination.faint", F);
+      converged = findFaint(F, faintStats, faint);
+      faintTime = faintStats.getElapsed();
+    }
+    {
+      PassStats ssaStats("dead-code-elimination.ssa", F);
+      markLive(F, live);
+      ssaTime = ssaStats.getElapsed();
+    }
+
+    errs() << "dead-code-elimination: " << F.getName() << ": faint found "
+           << faint.size() << (converged ? "" : " (not converged)")
+           << " dead in " << format("%.3f", faintTime * 1000)
+           << " ms, ssa found " << (F.getInstructionCount() - live.size())
+           << " dead in " << format("%.3f", ssaTime * 1000) << " ms\n";
+  }
+
+  /* Deletes the stores to local allocas that are never read before being
+   * overwritten, or before the function returns, and then the allocas that
+   * are never read at all.
+   *
+   * Only allocas whose address does not escape are considered: every pointer
+   * derived from one, through GEPs and bitcasts, may only be loaded from or
+   * stored to, so no call can read the memory. A backward dataflow analysis
+   * then finds, at each point, the allocas that may still be read, with one
+   * bit per alloca. A load makes its alloca live, and a store that writes the
+   * whole alloca kills it. A store to an alloca that is not live below it is
+   * dead. Returns the number of stores and allocas deleted.
+   */
+  unsigned eliminateDeadStores(Function &F, PassStats &stats) {
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    findLocalAllocas(F);
+    if (allocas.empty())
+      return 0;
+
+    map<BasicBlock *, struct bbInfo *> storeInfo;
+    for (po_iterator<BasicBlock *> itr = po_begin(&F.getEntryBlock());
+         itr != po_end(&F.getEntryBlock()); ++itr) {
+      BasicBlock *basicBlk = *itr;
+      struct bbInfo *info = new bbInfo();
+      info->ref = basicBlk;
+      info->genSet = BitVector(allocas.size(), false);
+      info->killSet = BitVector(allocas.size(), false);
+
+      for (BasicBlock::reverse_iterator rItr = basicBlk->rbegin();
+           rItr != basicBlk->rend(); ++rItr) {
+        int alloca;
+        bool full;
+        if (isLocalLoad(&*rItr, alloca)) {
+          info->genSet.set(alloca);
+        } else if (isLocalStore(&*rItr, DL, alloca, full) && full) {
+          // the alloca is overwritten, so reads below do not reach above
+          info->genSet.reset(alloca);
+          info->killSet.set(alloca);
         }
       }
+      storeInfo.insert({basicBlk, info});
+    }
 
-      // delete the instruction from code
-      for (auto ins : insToDel) {
-        if (!ins->use_empty())
+    // Allocas are dead once the function returns.
+    BitVector boundaryCond(allocas.size(), false);
+    BitVector initCond(allocas.size(), false);
+    DeadStoreAnalysis dsa(allocas.size(), boundaryCond, initCond);
+    dsa.run(F, storeInfo);
+    stats.addAnalysis(dsa);
+
+    vector<Instruction *> deadStores;
+    if (dsa.hasConverged()) {
+      for (BasicBlock &BB : F) {
+        BasicBlock *blk = &BB;
+        // unreachable blocks are not analysed
+        if (!storeInfo.count(blk))
           continue;
-        errs() << "Instruction deleted: " << *(Value *)&*ins << "\n";
-        ins->replaceAllUsesWith(UndefValue::get(ins->getType()));
-        ins->eraseFromParent();
+        BitVector liveAllocas = dsa.getResult(blk)->bbOutput;
+        for (BasicBlock::reverse_iterator rItr = blk->rbegin();
+             rItr != blk->rend(); ++rItr) {
+          int alloca;
+          bool full;
+          if (isLocalLoad(&*rItr, alloca)) {
+            liveAllocas.set(alloca);
+          } else if (isLocalStore(&*rItr, DL, alloca, full)) {
+            if (!liveAllocas[alloca])
+              deadStores.push_back(&*rItr);
+            if (full)
+              liveAllocas.reset(alloca);
+          }
+        }
+      }
+    }
+    for (auto &entry : storeInfo) {
+      delete entry.second;
+    }
+
+    for (Instruction *store : deadStores) {
+      errs() << "Instruction deleted: " << *store << "\n";
+      store->eraseFromParent();
+      ++NumStoresDeleted;
+    }
+    unsigned allocasDeleted = eliminateUnusedAllocas();
+    stats.addTransform("stores_deleted", deadStores.size());
+    stats.addTransform("allocas_deleted", allocasDeleted);
+    return deadStores.size() + allocasDeleted;
+  }
+
+  /* Collects the allocas of F whose address does not escape, and numbers
+   * them. Every pointer derived from an alloca must be used by a simple load
+   * or store of it, by a GEP or bitcast, or by a lifetime marker.
+   */
+  void findLocalAllocas(Function &F) {
+    allocas.clear();
+    pointerToAlloca.clear();
+
+    for (Instruction &I : F.getEntryBlock()) {
+      AllocaInst *AI = dyn_cast<AllocaInst>(&I);
+      if (!AI)
+        continue;
+
+      SmallVector<Instruction *, 8> pointers;
+      pointers.push_back(AI);
+      bool escapes = false;
+      for (unsigned pos = 0; pos < pointers.size() && !escapes; ++pos) {
+        Instruction *ptr = pointers[pos];
+        for (User *U : ptr->users()) {
+          Instruction *user = cast<Instruction>(U);
+          if (LoadInst *load = dyn_cast<LoadInst>(user)) {
+            escapes = !load->isSimple();
+          } else if (StoreInst *store = dyn_cast<StoreInst>(user)) {
+            escapes = !store->isSimple() || store->getValueOperand() == ptr;
+          } else if (isa<GetElementPtrInst>(user) || isa<BitCastInst>(user)) {
+            pointers.push_back(user);
+          } else {
+            escapes = !user->isLifetimeStartOrEnd();
+          }
+          if (escapes)
+            break;
+        }
+      }
+      if (escapes)
+        continue;
+
+      for (Instruction *ptr : pointers) {
+        pointerToAlloca[ptr] = allocas.size();
+      }
+      allocas.push_back(AI);
+    }
+  }
+
+  // Returns true if I loads from a local alloca, which is returned in alloca.
+  bool isLocalLoad(Instruction *I, int &alloca) {
+    LoadInst *load = dyn_cast<LoadInst>(I);
+    if (!load)
+      return false;
+    auto found = pointerToAlloca.find(load->getPointerOperand());
+    if (found == pointerToAlloca.end())
+      return false;
+    alloca = found->second;
+    return true;
+  }
+
+  /* Returns true if I stores to a local alloca, which is returned in alloca.
+   * full is set if the store writes the whole alloca.
+   */
+  bool isLocalStore(Instruction *I, const DataLayout &DL, int &alloca,
+                    bool &full) {
+    StoreInst *store = dyn_cast<StoreInst>(I);
+    if (!store)
+      return false;
+    Value *ptr = store->getPointerOperand();
+    auto found = pointerToAlloca.find(ptr);
+    if (found == pointerToAlloca.end())
+      return false;
+    alloca = found->second;
+
+    AllocaInst *AI = allocas[alloca];
+    Optional<TypeSize> allocaSize = AI->getAllocationSizeInBits(DL);
+    TypeSize storeSize =
+        DL.getTypeStoreSizeInBits(store->getValueOperand()->getType());
+    full = ptr->stripPointerCasts() == AI && allocaSize &&
+           !allocaSize->isScalable() && !storeSize.isScalable() &&
+           storeSize.getFixedSize() >= allocaSize->getFixedSize();
+    return true;
+  }
+
+  /* Deletes the local allocas that are never loaded from, along with the
+   * pointers derived from them and their lifetime markers. Their stores are
+   * all dead, and have already been deleted. Returns the number of allocas
+   * deleted.
+   */
+  unsigned eliminateUnusedAllocas() {
+    unsigned deleted = 0;
+    for (AllocaInst *AI : allocas) {
+      SmallVector<Instruction *, 8> tree;
+      tree.push_back(AI);
+      bool loaded = false;
+      for (unsigned pos = 0; pos < tree.size() && !loaded; ++pos) {
+        for (User *U : tree[pos]->users()) {
+          Instruction *user = cast<Instruction>(U);
+          if (isa<LoadInst>(user) || isa<StoreInst>(user)) {
+            loaded = true;
+            break;
+          }
+          tree.push_back(user);
+        }
       }
+      if (loaded)
+        continue;
+
+      for (Instruction *I : tree) {
+        errs() << "Instruction deleted: " << *I << "\n";
+        I->dropAllReferences();
+      }
+      for (Instruction *I : tree) {
+        I->eraseFromParent();
+      }
+      ++NumAllocasDeleted;
+      ++deleted;
     }
+    return deleted;
   }
 
   /**
-   * This function populates the map we maintain to
-   * keep track of the instructions and their respective indices.
-   *
-   * It also initializes the gen and kill set for each
+   * This function initializes the gen and kill set for each
    * basic block in the domain. In Faint analysis, we need to
    * special handle the phi nodes too.
    */
-  void populateInfoMap(Function &F) {
-    // BitVector empty(domain.size(), false);
-    int counter = 0;
-
-    for (auto I : domain) {
-      domainToBitMap[I] = counter;
-      bitToDomainMap[counter] = I;
-      ++counter;
-    }
+  void populateInfoMap(Function &F,
+                       const SmallPtrSetImpl<Instruction *> &knownFaint) {
+    clearInfoMap();
 
     // In Faint analysis, we do in the backward direction.
     // since we want to visit all successors before the node,
@@ -139,93 +732,106 @@ private:
            rItr != basicBlk->rend(); ++rItr) {
         Instruction *I = &(*rItr);
 
-        // phi nodes
-
-        for (int operands = 0; operands < I->getNumOperands(); ++operands) {
-          Value *val = I->getOperand(operands);
-
-          if (PHINode *p = dyn_cast<PHINode>(val)) {
-            for (int i = 0; i < p->getNumIncomingValues(); ++i) {
-              auto v = p->getIncomingValue(i);
-
-              auto foundInDomain = find(domain.begin(), domain.end(), v);
-              if (foundInDomain != domain.end()) {
-                info->killSet.set(domainToBitMap[(Instruction *)v]);
-              }
-            }
-          }
-        }
-
-        // gen
-        auto foundInDomain = find(domain.begin(), domain.end(), I);
-        if (foundInDomain != domain.end() &&
-            !(info->killSet[domainToBitMap[I]])) {
-          info->genSet.set(domainToBitMap[I]);
+        // gen. In SSA form the definition is above all of its uses in the
+        // block, as the Phis use their operands in their predecessors, so the
+        // value is faint on entry even if it is used later on.
+        auto foundInDomain = domainToBitMap.find(I);
+        if (foundInDomain != domainToBitMap.end()) {
+          info->genSet.set(foundInDomain->second);
         }
 
-        // kill
-        for (int operands = 0; operands < I->getNumOperands(); ++operands) {
-          Value *val = I->getOperand(operands);
-
-          auto foundInDomain = find(domain.begin(), domain.end(), val);
-          if (foundInDomain != domain.end()) {
-            info->killSet.set(domainToBitMap[(Instruction *)val]);
+        // kill, unless I is known to be faint
+        if (knownFaint.count(I) || isa<PHINode>(I))
+          continue;
+        for (Use &op : I->operands()) {
+          auto foundInDomain =
+              domainToBitMap.find(dyn_cast<Instruction>(op.get()));
+          if (foundInDomain != domainToBitMap.end()) {
+            info->killSet.set(foundInDomain->second);
           }
         }
       }
 
+      // phi nodes of the successors
+      SmallVector<int, 8> uses;
+      collectEdgeUses(basicBlk, knownFaint, uses);
+      for (int use : uses)
+        info->killSet.set(use);
+
       // populate the info map
       infoMap.insert({basicBlk, info});
     }
   }
 
+  /* A Phi uses each incoming value at the end of the predecessor it comes
+   * from, not in its own block, where the value may not be defined yet.
+   * Collects the positions of the values that the Phis of the successors of
+   * BB, apart from the ones known to be faint, use on the edges from BB.
+   */
+  void collectEdgeUses(BasicBlock *BB,
+                       const SmallPtrSetImpl<Instruction *> &knownFaint,
+                       SmallVectorImpl<int> &uses) {
+    for (BasicBlock *succ : successors(BB)) {
+      for (PHINode &phi : succ->phis()) {
+        if (knownFaint.count(&phi))
+          continue;
+        auto foundInDomain = domainToBitMap.find(
+            dyn_cast<Instruction>(phi.getIncomingValueForBlock(BB)));
+        if (foundInDomain != domainToBitMap.end())
+          uses.push_back(foundInDomain->second);
+      }
+    }
+  }
+
+  void clearInfoMap() {
+    for (auto &entry : infoMap) {
+      delete entry.second;
+    }
+    infoMap.clear();
+  }
+
+  /* Numbers the instructions that are not live, in program order. The state
+   * of the previous function is discarded.
+   */
   void setupDomain(Function &F) {
+    clearInfoMap();
+    domain.clear();
+    domainToBitMap.clear();
+
     for (auto &BB : F) {
       for (auto &I : BB) {
         Instruction *ins = &I;
-        if (!isLive(ins))
+        if (!isLive(ins)) {
+          domainToBitMap[ins] = domain.size();
           domain.push_back(ins);
+        }
       }
     }
   }
 
-  class DeadCodeEliminationAnalysis : public Dataflow {
+  /**
+   * Faint analysis is a Backward pass, with INTERSECTION as the meet operator,
+   * and F(x) = (X - Kill) U Gen as the transfer function.
+   */
+  class DeadCodeEliminationAnalysis
+      : public StaticDataflow<BACKWARD, IntersectMeet, GenKillTransfer> {
   public:
-    DeadCodeEliminationAnalysis(int domainSize, enum passDirection dir,
-                                BitVector boundaryCond, BitVector initCond)
-        : Dataflow(domainSize, dir, boundaryCond, initCond) {}
-
-    /**
-     * Transfer function for Faint analysis
-     */
-    virtual void transferFn(struct bbProps *props) {
-
-      auto kill = props->killSet;
-      auto gen = props->genSet;
-      auto out = props->bbOutput;
-      auto in = props->bbInput;
-
-      // For faint analysis, the transfer function is:
-      // F(x) = (X - Kill) U Gen
-      out = kill;
-      out.flip(); // -Kill
-      out &= in;
-      out |= gen; // union with gen
-
-      props->bbOutput = out;
-    }
+    DeadCodeEliminationAnalysis(int domainSize, BitVector boundaryCond,
+                                BitVector initCond)
+        : StaticDataflow(domainSize, boundaryCond, initCond) {}
+  };
 
-    /**
-     * Meet operator for the Faint analysis is INTERSECTION
-     */
-    virtual BitVector meetFn(vector<BitVector> inputs) {
-      size_t _sz = inputs.size();
-      BitVector result = inputs[0];
-      for (int itr = 1; itr < _sz; ++itr) {
-        result &= inputs[itr];
-      }
-      return result;
-    }
+  /**
+   * Dead store analysis is a Backward pass, with UNION as the meet operator,
+   * and F(x) = (X - Kill) U Gen as the transfer function, over the local
+   * allocas that may still be read.
+   */
+  class DeadStoreAnalysis
+      : public StaticDataflow<BACKWARD, UnionMeet, GenKillTransfer> {
+  public:
+    DeadStoreAnalysis(int domainSize, BitVector boundaryCond,
+                      BitVector initCond)
+        : StaticDataflow(domainSize, boundaryCond, initCond) {}
   };
 };
 
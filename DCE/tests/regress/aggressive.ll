@@ -0,0 +1,34 @@
+; The loop only computes %s, which is never used, so the aggressive mode
+; replaces its conditional branch with a jump to the exit, which leaves the
+; loop without a back edge, and removes everything else in it.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK-NOT: phi
+; CHECK-NOT: icmp
+; CHECK: loop:
+; CHECK-NEXT: br label %exit
+; CHECK: ret i32 %a
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define i32 @f(i32 %n, i32 %a) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s1, %loop ]
+  %s1 = add i32 %s, %i
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret i32 %a
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 10, i32 42)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  ret i32 0
+}
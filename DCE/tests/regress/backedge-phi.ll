@@ -0,0 +1,31 @@
+; %snext is defined below the Phi of its own block, which uses it on the
+; backedge, so it is live at the end of the block and must not be deleted.
+
+; CHECK-LABEL: define void @f(
+; CHECK: loop:
+; CHECK: %s = phi i32 [ 0, %entry ], [ %snext, %loop ]
+; CHECK: %snext = add i32 %s, 5
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define void @f(i32 %n) {
+entry:
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %snext, %loop ]
+  call i32 (i8*, ...) @printf(i8* %p, i32 %s)
+  %snext = add i32 %s, 5
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+define i32 @main() {
+  call void @f(i32 3)
+  ret i32 0
+}
@@ -0,0 +1,34 @@
+; The first store to %x is overwritten before it is read, and %y is never
+; read at all, so both stores and %y are deleted, and so is %d, which only
+; fed a dead store.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %x = alloca i32
+; CHECK-NEXT: %s = add i32 %a, %b
+; CHECK-NEXT: store i32 %s, i32* %x
+; CHECK-NEXT: %r = load i32, i32* %x
+; CHECK-NEXT: ret i32 %r
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define i32 @f(i32 %a, i32 %b) {
+entry:
+  %x = alloca i32
+  %y = alloca i32
+  %d = mul i32 %a, %b
+  store i32 %d, i32* %x
+  store i32 %a, i32* %y
+  %s = add i32 %a, %b
+  store i32 %s, i32* %x
+  %r = load i32, i32* %x
+  ret i32 %r
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 3, i32 4)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  ret i32 0
+}
@@ -0,0 +1,37 @@
+; A dead chain whose links are in different blocks: %z only feeds %y, which
+; only feeds %x. The faint mode deletes the whole chain in one run.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK-NOT: %x =
+; CHECK-NOT: %y =
+; CHECK-NOT: %z =
+; CHECK: ret i32 %s
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define i32 @f(i32 %a, i32 %b, i1 %c) {
+entry:
+  %z = mul i32 %a, %b
+  %s = add i32 %a, 1
+  br i1 %c, label %left, label %right
+left:
+  %y = add i32 %z, 3
+  br label %inner
+inner:
+  %x = shl i32 %y, 2
+  br label %join
+right:
+  br label %join
+join:
+  ret i32 %s
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 3, i32 4, i1 true)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  %r2 = call i32 @f(i32 5, i32 -9, i1 false)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r2)
+  ret i32 0
+}
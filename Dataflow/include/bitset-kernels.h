@@ -0,0 +1,92 @@
+#ifndef __BITSET_KERNELS_H__
+#define __BITSET_KERNELS_H__
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace llvm {
+
+/* Fused bit-set kernels for the Dataflow framework. Each kernel computes its
+ * result in a single pass over the words of its operands, and returns true if
+ * the destination changed, so that callers do not need to keep a copy of the
+ * old value to detect convergence.
+ *
+ * The implementation is selected once, at load time, from the instruction set
+ * extensions the CPU supports: AVX2 (256-bit lanes), SSE2 (128-bit lanes), or
+ * a portable scalar loop.
+ *
+ * All operands of a call must have the same number of words, and the
+ * destination must not alias any source.
+ */
+namespace bitkernels {
+
+typedef uintptr_t word;
+
+enum isaLevel {
+  SCALAR = 0,
+  SSE2 = 1,
+  AVX2 = 2,
+};
+
+// The implementation in use, and its name.
+enum isaLevel getISALevel();
+const char *getISAName();
+
+// Selects a specific implementation, e.g. to cross-check the SIMD kernels
+// against the scalar ones. If the CPU does not support level, the best level
+// below it is used instead.
+void setISALevel(enum isaLevel level);
+
+// dst = (src - kill) U gen
+bool andNotOr(word *dst, const word *src, const word *kill, const word *gen,
+              size_t numWords);
+
+// dst = (src U plus) - minus
+bool orAndNot(word *dst, const word *src, const word *plus, const word *minus,
+              size_t numWords);
+
+// dst = srcs[0] n srcs[1] n ... n srcs[numSrcs - 1], numSrcs > 0
+bool meetIntersect(word *dst, const word *const *srcs, size_t numSrcs,
+                   size_t numWords);
+
+// dst = srcs[0] U srcs[1] U ... U srcs[numSrcs - 1], numSrcs > 0
+bool meetUnion(word *dst, const word *const *srcs, size_t numSrcs,
+               size_t numWords);
+
+/* BitVector adapters. BitVector keeps the unused bits of its last word
+ * cleared, and none of the kernels can set them, so they can operate on the
+ * raw words directly.
+ */
+
+// Mutable access to the words of B. The storage is owned by B, so writing
+// through it is well-defined as long as B is not resized.
+inline word *words(BitVector &B) {
+  return B.empty() ? nullptr : const_cast<word *>(B.getData().data());
+}
+
+inline const word *words(const BitVector &B) {
+  return B.empty() ? nullptr : B.getData().data();
+}
+
+inline size_t numWords(const BitVector &B) {
+  return B.empty() ? 0 : B.getData().size();
+}
+
+inline bool andNotOr(BitVector &dst, const BitVector &src,
+                     const BitVector &kill, const BitVector &gen) {
+  return andNotOr(words(dst), words(src), words(kill), words(gen),
+                  numWords(dst));
+}
+
+inline bool orAndNot(BitVector &dst, const BitVector &src,
+                     const BitVector &plus, const BitVector &minus) {
+  return orAndNot(words(dst), words(src), words(plus), words(minus),
+                  numWords(dst));
+}
+} // namespace bitkernels
+} // namespace llvm
+
+#endif
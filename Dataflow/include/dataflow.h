@@ -1,6 +1,7 @@
 #ifndef __CLASSICAL_DATAFLOW_H__
 #define __CLASSICAL_DATAFLOW_H__
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/PostOrderIterator.h"
@@ -11,6 +12,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/ValueMap.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <iostream>
@@ -37,6 +39,12 @@ enum bbType {
   REGULAR = 2,
 };
 
+// enum to denote the strategy used to reach the fixed point
+enum solverMode {
+  SWEEP = 0,    // Re-visit every block in traversal order on each iteration
+  WORKLIST = 1, // Re-visit only the blocks whose meet inputs have changed
+};
+
 /* This struct is used to abstract the details that a client of this API needs
  * to be provide about each BasicBlock. This contains a reference to the
  * BasicBlock, its genSet, and its killSet.
@@ -48,54 +56,290 @@ struct bbInfo {
 };
 
 /* This struct is used to abstract all relevant details of a BasicBlock that
- * this API needs to run an iterative dataflow analysis pass.
+ * this API needs to run an iterative dataflow analysis pass. The framework
+ * keeps the BitVectors of all blocks in contiguous per-field arrays, indexed by
+ * block number, and a bbProps is a handle that refers into those arrays. It is
+ * therefore only valid for as long as the Dataflow object that produced it.
  */
 struct bbProps {
-  enum bbType type;             // BasicBlock type
-  BasicBlock *ref;              // Pointer to the BasicBlock
-  BitVector bbInput;            // Input BitVector
-  BitVector bbOutput;           // Output BitVector
-  BitVector genSet;             // Gen Set
-  BitVector killSet;            // Kill set
-  vector<BasicBlock *> pBlocks; // Predecessor Blocks
-  vector<BasicBlock *> sBlocks; // Successor Blocks
+  enum bbType type;    // BasicBlock type
+  BasicBlock *ref;     // Pointer to the BasicBlock
+  BitVector &bbInput;  // Input BitVector
+  BitVector &bbOutput; // Output BitVector
+  BitVector &genSet;   // Gen Set
+  BitVector &killSet;  // Kill set
+};
+
+/* Counters describing a single run of the framework. A sweep is one pass over
+ * the blocks in traversal order; the worklist solver starts a new sweep every
+ * time it has to go back to an earlier block. bitsChanged counts, for every
+ * visit that changed the state a block propagates, the number of bits that
+ * changed, or the net change in its size where the exact difference would
+ * need a copy of the old state. bytesAllocated is the heap footprint of the
+ * per-block state and edge lists built by initialize().
+ */
+struct dataflowMetrics {
+  unsigned long sweeps;         // Passes over the traversal order
+  unsigned long visits;         // Block visits
+  unsigned long bitsChanged;    // Bits changed in propagated states
+  unsigned long bytesAllocated; // Bytes of per-block state
+  bool converged;               // The fixed point was reached
 };
 
 class Dataflow {
 
-private:
+protected:
   int domainSize;         // Size of the domain ~ Length of the Domain BitVector
   enum passDirection dir; // Pass Direction
+  enum solverMode mode;   // Strategy used to reach the fixed point
   vector<BasicBlock *> poTraversal;  // Post-order traversal vector
   vector<BasicBlock *> rpoTraversal; // Reverse Post-order traversal vector
 
-  void populateEdges(BasicBlock *BB, struct bbProps *props);
-  void initialize(Function &F, map<BasicBlock *, struct bbInfo *> infoMap);
+  /* Blocks are numbered once, in reverse post-order, followed by any blocks
+   * that are unreachable from the entry. All per-block state below is indexed
+   * by that number.
+   */
+  int numBlocks;    // Number of blocks in the function
+  int numReachable; // Number of blocks reachable from the entry block
+  DenseMap<BasicBlock *, int> blockIndex; // BasicBlock to block number
+  vector<BasicBlock *> blockRefs;         // Block number to BasicBlock
+  vector<enum bbType> blockTypes;         // Block types
+  vector<BitVector> inputs;               // Input BitVectors
+  vector<BitVector> outputs;              // Output BitVectors
+  vector<BitVector> genSets;              // Gen Sets
+  vector<BitVector> killSets;             // Kill Sets
+  vector<struct bbProps> props;           // Handles passed to transferFn
+
+  // Predecessor and successor lists in compressed sparse row form. The
+  // neighbours of block i are xxxList[xxxStart[i]] .. xxxList[xxxStart[i+1]-1].
+  vector<int> predStart;
+  vector<int> predList;
+  vector<int> succStart;
+  vector<int> succList;
+  int maxDegree; // Largest number of predecessors or successors of a block
+
+  // Scratch state reused by every block visit, so that the fixed-point loop
+  // does not allocate once the framework is initialized.
+  vector<const BitVector *> meetInputs; // Neighbour states handed to meetInto
+  BitVector prevState; // Propagated state of the block before the visit
+
+  // Number of heap allocations made by the framework after initialization.
+  unsigned long steadyStateAllocations;
+
+  unsigned maxIterations;         // Sweep cap requested by the client
+  struct dataflowMetrics metrics; // Counters for the current run
+
+  void numberBlocks(Function &F);
+  void populateEdges();
+  void initialize(Function &F, const map<BasicBlock *, struct bbInfo *> &infoMap);
   void initializeBlocks(struct bbProps *block);
+  void trackAllocation(const BitVector &B, const void *before);
+
+  /* Allocates the per-block state, from the gen and kill sets of the info
+   * map, and the boundary and initial conditions, once the blocks are
+   * numbered and their edges built. Subclasses that keep their state in
+   * another form can override it, provided they fill the per-block arrays and
+   * props by the end of solve().
+   */
+  virtual void initializeState(
+      const map<BasicBlock *, struct bbInfo *> &infoMap);
+
+  // Heap footprint of the per-block state and edge lists.
+  virtual unsigned long stateBytes() const;
   virtual void populateTraversal(Function &F);
-  
+  unsigned processBlock(int idx);
+  unsigned iterationCap() const;
+  void reportCap(Function &F);
+
+  // Returns the address of the words owned by B, or nullptr if it owns none.
+  static const void *storageOf(const BitVector &B) {
+    return B.empty() ? nullptr : B.getData().data();
+  }
+
+  // Position of a block in the traversal order. Block numbers follow RPO, so
+  // this is the number itself for a Forward pass, and the number counted from
+  // the end otherwise. The mapping is its own inverse.
+  int position(int idx) const {
+    return (dir == FORWARD) ? idx : numReachable - 1 - idx;
+  }
+
+  /* Iterates to the fixed point. The default implementation visits blocks
+   * with processBlock, which dispatches to meetInto and transferFn. Subclasses
+   * that know their meet and transfer functions statically can override it,
+   * and drive runSweep or runWorklist with their own visitor.
+   *
+   * Both solvers take a visitor, where visit(idx) processes block number idx,
+   * and returns the number of bits of its propagated state that changed, or 0
+   * if it did not change. They stop early, and leave metrics.converged unset,
+   * if the fixed point has not been reached after iterationCap() sweeps.
+   */
+  virtual void solve();
+
+  /* Round-robin solver. Every block is visited in traversal order on each
+   * iteration, until an iteration completes without any block changing.
+   */
+  template <typename Visitor> void runSweep(Visitor visit) {
+    unsigned cap = iterationCap();
+    bool converged = false;
+
+    // Begin Dataflow iteration.
+    while (!converged) {
+      if (cap && metrics.sweeps == cap)
+        return;
+      ++metrics.sweeps;
+
+      converged = true;
+      for (int pos = 0; pos < numReachable; ++pos) {
+        unsigned changed = visit(position(pos));
+        ++metrics.visits;
+        if (changed) {
+          metrics.bitsChanged += changed;
+          converged = false;
+        }
+      }
+    }
+    metrics.converged = true;
+  }
+
+  /* Worklist solver. Every block starts on the worklist, and blocks are
+   * processed in sweeps over the traversal order (RPO for a Forward pass, PO
+   * for a Backward pass), lowest position first. A block is only re-queued
+   * when one of the blocks feeding its meet function has changed, i.e. the
+   * successors of a changed block in a Forward pass, and its predecessors in a
+   * Backward pass. A block that is re-queued behind the current position
+   * waits for the next sweep, as it would in the round-robin solver, so the
+   * worklist never needs more sweeps than runSweep. The analysis has converged
+   * when the worklist is empty.
+   */
+  template <typename Visitor> void runWorklist(Visitor visit) {
+    unsigned cap = iterationCap();
+    priority_queue<int, vector<int>, greater<int>> worklist;  // This sweep
+    priority_queue<int, vector<int>, greater<int>> nextSweep; // The next one
+    vector<bool> queued(numReachable, true);
+    for (int pos = 0; pos < numReachable; ++pos) {
+      worklist.push(pos);
+    }
+
+    const vector<int> &depStart = (dir == FORWARD) ? succStart : predStart;
+    const vector<int> &depList = (dir == FORWARD) ? succList : predList;
+
+    while (!worklist.empty()) {
+      if (cap && metrics.sweeps == cap)
+        return;
+      ++metrics.sweeps;
+
+      while (!worklist.empty()) {
+        int pos = worklist.top();
+        int idx = position(pos);
+        worklist.pop();
+        queued[idx] = false;
+
+        unsigned changed = visit(idx);
+        ++metrics.visits;
+        if (!changed)
+          continue;
+        metrics.bitsChanged += changed;
+
+        // Unreachable blocks are never part of the traversal, and are never
+        // queued.
+        for (int e = depStart[idx]; e < depStart[idx + 1]; ++e) {
+          int dep = depList[e];
+          if (dep >= numReachable || queued[dep])
+            continue;
+          queued[dep] = true;
+          if (position(dep) > pos) {
+            worklist.push(position(dep));
+          } else {
+            nextSweep.push(position(dep));
+          }
+        }
+      }
+      std::swap(worklist, nextSweep);
+    }
+    metrics.converged = true;
+  }
+
 public:
+  // Compatibility view of the results, keyed by BasicBlock. It is populated
+  // once run() has finished, and points into the framework's own storage.
   map<BasicBlock *, struct bbProps *> result;
   BitVector initCond; // Initial Condition for the framework
   BitVector boundaryCond; // Boundary Condition for the framework
 
   Dataflow(int domainSize, enum passDirection dir, BitVector boundaryCond,
-           BitVector initCond) {
+           BitVector initCond, enum solverMode mode = WORKLIST) {
     this->domainSize = domainSize;
     this->dir = dir;
     this->boundaryCond = boundaryCond;
     this->initCond = initCond;
+    this->mode = mode;
+    this->numBlocks = 0;
+    this->numReachable = 0;
+    this->maxDegree = 0;
+    this->steadyStateAllocations = 0;
+    this->maxIterations = 0;
+    this->metrics = {0, 0, 0, 0, false};
+  }
+
+  virtual ~Dataflow() {}
+
+  // Selects the strategy used by run(). Must be called before run().
+  void setSolverMode(enum solverMode mode) { this->mode = mode; }
+
+  /* Caps the number of sweeps run() may take to reach the fixed point. The
+   * default, 0, derives the cap from the function: numReachable + 2 sweeps,
+   * which bounds any gen/kill problem solved in traversal order (Kam and
+   * Ullman bound it by the loop connectedness of the CFG + 2), so only a
+   * transfer function that is not monotone can hit it. If the cap is hit, the
+   * results are not a fixed point, hasConverged() returns false, and a warning
+   * is emitted for the function.
+   */
+  void setMaxIterations(unsigned maxIterations) {
+    this->maxIterations = maxIterations;
+  }
+
+  // Returns true if the last run() reached the fixed point.
+  bool hasConverged() { return metrics.converged; }
+
+  // Counters for the last run().
+  const struct dataflowMetrics &getMetrics() { return metrics; }
+
+  int getDomainSize() { return domainSize; }
+
+  // Returns the result for BB in constant time, or nullptr if BB is not part
+  // of the function the analysis was run on.
+  struct bbProps *getResult(BasicBlock *BB) {
+    auto it = blockIndex.find(BB);
+    return it == blockIndex.end() ? nullptr : &props[it->second];
   }
 
+  /* Returns the number of heap allocations the framework made after it was
+   * initialized, i.e. while iterating to the fixed point. Buffers that had to
+   * grow are detected by their address changing, and every call through the
+   * legacy meetFn adapter is charged for its argument and result copies. Clients
+   * that override meetInto and keep transferFn in-place should see zero.
+   */
+  unsigned long getSteadyStateAllocations() { return steadyStateAllocations; }
+
   void displayVector(BitVector b);
-  // abstract function to define the meet operator
-  virtual BitVector meetFn(vector<BitVector> input) = 0;
 
-  // abstract Transfer function
+  /* Meet operator. Writes the meet of *inputs[0] .. *inputs[n-1] into dst,
+   * reusing the storage dst already owns. inputs is never empty, and dst never
+   * aliases any of the inputs. The default implementation is an adapter that
+   * calls meetFn, for analyses written against the older API.
+   */
+  virtual void meetInto(BitVector &dst, ArrayRef<const BitVector *> inputs);
+
+  // Legacy meet operator, taking copies of the inputs and returning a new
+  // BitVector. Only used if meetInto is not overridden.
+  virtual BitVector meetFn(vector<BitVector> input);
+
+  // abstract Transfer function. It should update the block's BitVectors in
+  // place, without creating temporaries.
   virtual void transferFn(struct bbProps *block) = 0;
 
   // Execution of the Dataflow Analysis algorithm.
-  void run(Function &F, map<BasicBlock *, struct bbInfo *> infoMap);
+  void run(Function &F, const map<BasicBlock *, struct bbInfo *> &infoMap);
 };
 } // namespace llvm
 
@@ -0,0 +1,69 @@
+#ifndef __PASS_STATS_H__
+#define __PASS_STATS_H__
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+
+#include "dataflow.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace llvm {
+
+/* Per-function instrumentation shared by all passes. A PassStats object is
+ * created at the top of a pass's entry point, and collects, for the function
+ * (or loop) being processed:
+ *   - the wall time spent until it goes out of scope,
+ *   - the work done by every Dataflow analysis handed to addAnalysis(), i.e.
+ *     sweeps, block visits, bits changed, domain size and bytes allocated,
+ *   - the transformations counted with addTransform().
+ *
+ * The passes report the same counters as STATISTICs, and the Dataflow
+ * framework registers its own -time-passes timers. In addition, if the
+ * DATAFLOW_STATS_JSON environment variable names a file, every record is
+ * appended to that file as a JSON object on a line of its own, so that the
+ * records of several opt invocations can be collected in one place. An
+ * environment variable is used rather than a command-line option, since every
+ * pass plugin links this file, and opt cannot load two plugins that register
+ * the same option.
+ */
+class PassStats {
+private:
+  string passName;
+  string functionName;
+  string loopName; // Header of the loop, for loop passes
+  double startTime; // Wall clock time at construction, in seconds
+
+  unsigned long analyses;
+  unsigned long sweeps;
+  unsigned long visits;
+  unsigned long bitsChanged;
+  unsigned long bytesAllocated;
+  int domainSize; // Largest domain of the analyses run
+  bool converged; // Every analysis reached its fixed point
+
+  vector<pair<string, unsigned long>> transforms;
+
+  void writeJSON(StringRef path, double wallTime);
+
+public:
+  PassStats(StringRef passName, Function &F);
+  PassStats(StringRef passName, Function &F, BasicBlock *loopHeader);
+  ~PassStats();
+
+  // Accumulates the metrics of a Dataflow analysis that has been run.
+  void addAnalysis(Dataflow &dfa);
+
+  // Counts count transformations of the given kind, e.g. "deleted".
+  void addTransform(StringRef kind, unsigned long count = 1);
+
+  // Wall time since construction, in seconds.
+  double getElapsed() const;
+};
+} // namespace llvm
+
+#endif
@@ -0,0 +1,472 @@
+#ifndef __STATIC_DATAFLOW_H__
+#define __STATIC_DATAFLOW_H__
+
+#include "llvm/ADT/SparseBitVector.h"
+
+#include "bitset-kernels.h"
+#include "dataflow.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <utility>
+
+using namespace std;
+
+namespace llvm {
+
+// enum to denote the set representation used while iterating
+enum setRepresentation {
+  DENSE_SET = 0,  // One BitVector per block state
+  SPARSE_SET = 1, // One SparseBitVector per block state
+  AUTO_SET = 2,   // Chosen per run, from the domain size and density
+};
+
+// enum to denote the shape of a transfer function, where A and B are
+// per-block operands supplied by the Transfer policy
+enum transferShape {
+  ANDNOT_OR = 0, // F(X) = (X - A) U B
+  OR_ANDNOT = 1, // F(X) = (X U A) - B
+};
+
+/* A Meet policy combines the states of a block's neighbours. apply() computes
+ * the meet of all of them in one pass over the words, and returns true if dst
+ * changed. combine() folds a single BitVector into dst, and is used by the
+ * virtual meetInto path.
+ */
+
+// Meet operator: Intersection
+struct IntersectMeet {
+  static const bool isIntersection = true;
+  static bool apply(bitkernels::word *dst, const bitkernels::word *const *srcs,
+                    size_t numSrcs, size_t numWords) {
+    return bitkernels::meetIntersect(dst, srcs, numSrcs, numWords);
+  }
+  static void combine(BitVector &dst, const BitVector &in) { dst &= in; }
+};
+
+// Meet operator: Union
+struct UnionMeet {
+  static const bool isIntersection = false;
+  static bool apply(bitkernels::word *dst, const bitkernels::word *const *srcs,
+                    size_t numSrcs, size_t numWords) {
+    return bitkernels::meetUnion(dst, srcs, numSrcs, numWords);
+  }
+  static void combine(BitVector &dst, const BitVector &in) { dst |= in; }
+};
+
+/* Transfer function of the classical gen/kill problems, F(X) = (X - Kill) U Gen,
+ * where X is the result of the meet. A Transfer policy describes its function
+ * declaratively, so that it can be evaluated on any set representation:
+ *   shape                       - one of the transferShape forms
+ *   operandA(idx, gen, kill)    - the A operand of block number idx
+ *   operandB(idx, gen, kill)    - the B operand of block number idx
+ *   prepare(blocks)             - called with the BasicBlock of each block
+ *                                 number before the first visit, so that
+ *                                 per-block operands can be looked up by number
+ */
+struct GenKillTransfer {
+  static const enum transferShape shape = ANDNOT_OR;
+
+  void prepare(ArrayRef<BasicBlock *> /* blocks */) {}
+
+  const BitVector &operandA(int /* idx */, const BitVector & /* gen */,
+                            const BitVector &kill) {
+    return kill;
+  }
+  const BitVector &operandB(int /* idx */, const BitVector &gen,
+                            const BitVector & /* kill */) {
+    return gen;
+  }
+};
+
+/* Dataflow framework specialized at compile time for a direction, a meet
+ * operator and a transfer function. The fixed-point loop is driven by the
+ * same sweep and worklist solvers as Dataflow, but each block visit has the
+ * direction resolved statically, and inlines the meet loop and the transfer
+ * function instead of making two virtual calls. Analyses built on it are still
+ * Dataflow objects, and can be used through that interface.
+ *
+ * The block states can be iterated either as dense BitVectors, or as
+ * SparseBitVectors, whose cost scales with the number of facts rather than
+ * with the domain size. When most of the initial state is set, as with the
+ * Universal Set initial condition of an Intersection problem, the sparse sets
+ * hold the complement of each state instead. Intersection and Union swap
+ * under complement, and so do the two transfer shapes:
+ *   ~((X - A) U B) = (~X U A) - B
+ * A sparse run builds its sets straight from the info map, and allocates no
+ * dense per-block state while iterating. The results are converted back to
+ * the dense BitVectors of the Dataflow interface once the fixed point is
+ * reached, one block at a time. The gen and kill sets of its bbProps then
+ * refer to the client's info map, which is not copied.
+ */
+template <enum passDirection Dir, typename Meet, typename Transfer>
+class StaticDataflow : public Dataflow {
+protected:
+  typedef SparseBitVector<> SparseSet;
+
+  Transfer transfer;
+  enum setRepresentation repr; // Requested set representation
+
+  // Gen and kill sets of each block, by block number. They are the
+  // framework's copies in a dense run, and the client's sets in a sparse one.
+  vector<BitVector *> gens;
+  vector<BitVector *> kills;
+  BitVector noFacts; // Gen and kill sets of the blocks the client did not describe
+
+  vector<const bitkernels::word *> meetWords; // Scratch list of meet sources
+
+  // State of a run that uses the sparse representation
+  bool complemented; // Sparse sets hold the complement of each state
+  vector<SparseSet> sparseInputs;
+  vector<SparseSet> sparseOutputs;
+  vector<SparseSet> sparseA; // Transfer operand A, by block number
+  vector<SparseSet> sparseB; // Transfer operand B, by block number
+  SparseSet sparseScratch;
+  bool sparseRun; // The last run iterated over sparse sets
+
+  // Smallest domain for which AUTO_SET considers the sparse representation.
+  static const int SPARSE_MIN_DOMAIN = 1024;
+
+  // Estimated heap footprint of a SparseBitVector element, with its list node.
+  static const size_t SPARSE_ELEMENT_BYTES =
+      sizeof(SparseBitVectorElement<>) + 2 * sizeof(void *);
+
+  const BitVector &operandA(int idx) {
+    return transfer.operandA(idx, *gens[idx], *kills[idx]);
+  }
+  const BitVector &operandB(int idx) {
+    return transfer.operandB(idx, *gens[idx], *kills[idx]);
+  }
+
+  bool applyTransfer(BitVector &dst, const BitVector &meet, int idx) {
+    if (Transfer::shape == ANDNOT_OR)
+      return bitkernels::andNotOr(dst, meet, operandA(idx), operandB(idx));
+    return bitkernels::orAndNot(dst, meet, operandA(idx), operandB(idx));
+  }
+
+  /* Statically dispatched counterpart of Dataflow::processBlock. The meet and
+   * transfer kernels report whether they changed their destination, so no
+   * copy of the previous state is needed to detect convergence. The number of
+   * bits changed is taken from the change in size of the propagated state.
+   */
+  unsigned visit(int idx) {
+    BitVector &propagated = (Dir == FORWARD) ? outputs[idx] : inputs[idx];
+    BitVector &meet = (Dir == FORWARD) ? inputs[idx] : outputs[idx];
+    const vector<BitVector> &state = (Dir == FORWARD) ? outputs : inputs;
+    const vector<int> &start = (Dir == FORWARD) ? predStart : succStart;
+    const vector<int> &list = (Dir == FORWARD) ? predList : succList;
+    const void *propagatedStorage = storageOf(propagated);
+    const void *meetStorage = storageOf(meet);
+    unsigned before = propagated.count();
+
+    int first = start[idx], last = start[idx + 1];
+    if (first != last && domainSize > 0) {
+      meetWords.clear();
+      for (int e = first; e < last; ++e) {
+        meetWords.push_back(bitkernels::words(state[list[e]]));
+      }
+      Meet::apply(bitkernels::words(meet), meetWords.data(), meetWords.size(),
+                  bitkernels::numWords(meet));
+    }
+
+    bool changed = applyTransfer(propagated, meet, idx);
+
+    trackAllocation(propagated, propagatedStorage);
+    trackAllocation(meet, meetStorage);
+
+    return changed ? bitsChanged(before, propagated.count()) : 0;
+  }
+
+  // Sparse counterpart of visit().
+  unsigned visitSparse(int idx) {
+    SparseSet &propagated =
+        (Dir == FORWARD) ? sparseOutputs[idx] : sparseInputs[idx];
+    SparseSet &meet = (Dir == FORWARD) ? sparseInputs[idx] : sparseOutputs[idx];
+    const vector<SparseSet> &state =
+        (Dir == FORWARD) ? sparseOutputs : sparseInputs;
+    const vector<int> &start = (Dir == FORWARD) ? predStart : succStart;
+    const vector<int> &list = (Dir == FORWARD) ? predList : succList;
+    bool intersect = Meet::isIntersection != complemented;
+    bool andNotOr = (Transfer::shape == ANDNOT_OR) != complemented;
+
+    int first = start[idx], last = start[idx + 1];
+    if (first != last) {
+      meet = state[list[first]];
+      for (int e = first + 1; e < last; ++e) {
+        if (intersect)
+          meet &= state[list[e]];
+        else
+          meet |= state[list[e]];
+      }
+    }
+
+    if (andNotOr) {
+      sparseScratch.intersectWithComplement(meet, sparseA[idx]);
+      sparseScratch |= sparseB[idx];
+    } else {
+      sparseScratch = meet;
+      sparseScratch |= sparseA[idx];
+      sparseScratch.intersectWithComplement(sparseB[idx]);
+    }
+
+    if (sparseScratch == propagated)
+      return 0;
+    unsigned before = propagated.count();
+    std::swap(propagated, sparseScratch);
+    return bitsChanged(before, propagated.count());
+  }
+
+  // Bits changed by a visit that changed a state of size before to size after.
+  static unsigned bitsChanged(unsigned before, unsigned after) {
+    if (before == after)
+      return 1;
+    return before < after ? after - before : before - after;
+  }
+
+  // Converts src to a sparse set, in time proportional to its set bits.
+  static void toSparse(SparseSet &dst, const BitVector &src) {
+    dst.clear();
+    for (unsigned i : src.set_bits()) {
+      dst.set(i);
+    }
+  }
+
+  static void toSparse(SparseSet &dst, const BitVector &src, bool complement) {
+    if (!complement) {
+      toSparse(dst, src);
+      return;
+    }
+    BitVector flipped = src;
+    flipped.flip();
+    toSparse(dst, flipped);
+  }
+
+  static void toDense(BitVector &dst, const SparseSet &src, bool complement) {
+    if (complement)
+      dst.set();
+    else
+      dst.reset();
+    for (unsigned i : src) {
+      if (complement)
+        dst.reset(i);
+      else
+        dst.set(i);
+    }
+  }
+
+  // Number of SparseBitVector elements needed to hold the set bits of B.
+  static size_t sparseElements(const BitVector &B) {
+    const size_t wordsPerElement = SparseBitVectorElement<>::BITS_PER_ELEMENT /
+                                   (CHAR_BIT * sizeof(bitkernels::word));
+    const bitkernels::word *w = bitkernels::words(B);
+    size_t n = bitkernels::numWords(B), elements = 0;
+    for (size_t first = 0; first < n; first += wordsPerElement) {
+      for (size_t i = first; i < n && i < first + wordsPerElement; ++i) {
+        if (w[i]) {
+          ++elements;
+          break;
+        }
+      }
+    }
+    return elements;
+  }
+
+  /* Decides whether this run uses the sparse representation, and whether the
+   * sparse sets hold complements. AUTO_SET compares the memory the dense
+   * BitVectors need with an estimate for the sparse sets, from the transfer
+   * operands and the initial condition, which every block starts from.
+   */
+  bool chooseSparse() {
+    BitVector init = initCond;
+    complemented = 2 * (int)initCond.count() > domainSize;
+    if (complemented)
+      init.flip();
+
+    if (repr == DENSE_SET || domainSize == 0)
+      return false;
+    if (repr == SPARSE_SET)
+      return true;
+    if (domainSize < SPARSE_MIN_DOMAIN)
+      return false;
+
+    size_t elements = 2 * numReachable * sparseElements(init);
+    for (int idx = 0; idx < numReachable; ++idx) {
+      elements += sparseElements(operandA(idx)) + sparseElements(operandB(idx));
+    }
+    size_t sparseBytes = elements * SPARSE_ELEMENT_BYTES;
+    size_t denseBytes = 4 * numReachable * bitkernels::numWords(initCond) *
+                        sizeof(bitkernels::word);
+    return 2 * sparseBytes < denseBytes;
+  }
+
+  /* Sets up the sparse state of every block, with the same boundary and
+   * initial conditions as Dataflow::initializeBlocks. The state a block
+   * propagates starts from the initial condition. The meet of a block that
+   * has neighbours is computed before it is first read, so it is only set for
+   * the boundary blocks, and for the blocks that are never met into.
+   */
+  void initializeSparse() {
+    SparseSet init, boundary, empty;
+    toSparse(init, initCond, complemented);
+    toSparse(boundary, boundaryCond, complemented);
+    toSparse(empty, BitVector(domainSize, false), complemented);
+
+    sparseInputs.resize(numBlocks);
+    sparseOutputs.resize(numBlocks);
+    sparseA.resize(numBlocks);
+    sparseB.resize(numBlocks);
+    const vector<int> &start = (Dir == FORWARD) ? predStart : succStart;
+    for (int idx = 0; idx < numBlocks; ++idx) {
+      SparseSet &propagated =
+          (Dir == FORWARD) ? sparseOutputs[idx] : sparseInputs[idx];
+      SparseSet &meet =
+          (Dir == FORWARD) ? sparseInputs[idx] : sparseOutputs[idx];
+      propagated = init;
+      if (blockTypes[idx] == ((Dir == FORWARD) ? ENTRY : EXIT))
+        meet = boundary;
+      else if (idx >= numReachable || start[idx] == start[idx + 1])
+        meet = empty;
+
+      toSparse(sparseA[idx], operandA(idx));
+      toSparse(sparseB[idx], operandB(idx));
+    }
+  }
+
+  virtual void initializeState(
+      const map<BasicBlock *, struct bbInfo *> &infoMap) {
+    noFacts = BitVector(domainSize, false);
+    gens.assign(numBlocks, &noFacts);
+    kills.assign(numBlocks, &noFacts);
+    for (int idx = 0; idx < numBlocks; ++idx) {
+      auto info = infoMap.find(blockRefs[idx]);
+      if (info != infoMap.end()) {
+        gens[idx] = &info->second->genSet;
+        kills[idx] = &info->second->killSet;
+      }
+    }
+    transfer.prepare(blockRefs);
+
+    sparseRun = chooseSparse();
+    if (sparseRun) {
+      initializeSparse();
+      return;
+    }
+
+    Dataflow::initializeState(infoMap);
+    for (int idx = 0; idx < numBlocks; ++idx) {
+      gens[idx] = &genSets[idx];
+      kills[idx] = &killSets[idx];
+    }
+  }
+
+  /* Iterates over the sparse sets, then converts the results to the dense
+   * per-block arrays, releasing the sparse state of each block as it goes.
+   */
+  void solveSparse() {
+    auto visitor = [this](int idx) { return visitSparse(idx); };
+    if (mode == WORKLIST) {
+      runWorklist(visitor);
+    } else {
+      runSweep(visitor);
+    }
+
+    sparseA.clear();
+    sparseB.clear();
+    sparseScratch.clear();
+    inputs.resize(numBlocks);
+    outputs.resize(numBlocks);
+    for (int idx = 0; idx < numBlocks; ++idx) {
+      inputs[idx].resize(domainSize);
+      toDense(inputs[idx], sparseInputs[idx], complemented);
+      sparseInputs[idx].clear();
+      outputs[idx].resize(domainSize);
+      toDense(outputs[idx], sparseOutputs[idx], complemented);
+      sparseOutputs[idx].clear();
+    }
+    sparseInputs.clear();
+    sparseOutputs.clear();
+
+    props.reserve(numBlocks);
+    for (int idx = 0; idx < numBlocks; ++idx) {
+      props.push_back({blockTypes[idx], blockRefs[idx], inputs[idx],
+                       outputs[idx], *gens[idx], *kills[idx]});
+    }
+  }
+
+  // Number of SparseBitVector elements S is made of.
+  static size_t sparseElements(const SparseSet &S) {
+    const unsigned bits = SparseBitVectorElement<>::BITS_PER_ELEMENT;
+    size_t elements = 0;
+    unsigned last = 0;
+    for (unsigned i : S) {
+      if (elements == 0 || i / bits != last) {
+        last = i / bits;
+        ++elements;
+      }
+    }
+    return elements;
+  }
+
+  virtual unsigned long stateBytes() const {
+    unsigned long bytes = Dataflow::stateBytes();
+    if (!sparseRun)
+      return bytes;
+    for (const vector<SparseSet> *sets :
+         {&sparseInputs, &sparseOutputs, &sparseA, &sparseB}) {
+      bytes += sets->capacity() * sizeof(SparseSet);
+      for (const SparseSet &S : *sets) {
+        bytes += sparseElements(S) * SPARSE_ELEMENT_BYTES;
+      }
+    }
+    return bytes;
+  }
+
+  virtual void solve() {
+    if (sparseRun) {
+      solveSparse();
+      return;
+    }
+
+    meetWords.reserve(maxDegree);
+    auto visitor = [this](int idx) { return visit(idx); };
+    if (mode == WORKLIST) {
+      runWorklist(visitor);
+    } else {
+      runSweep(visitor);
+    }
+  }
+
+public:
+  StaticDataflow(int domainSize, BitVector boundaryCond, BitVector initCond,
+                 Transfer transfer = Transfer())
+      : Dataflow(domainSize, Dir, boundaryCond, initCond), transfer(transfer) {
+    this->repr = AUTO_SET;
+    this->complemented = false;
+    this->sparseRun = false;
+  }
+
+  // Selects the set representation used by run(). Must be called before run().
+  void setSetRepresentation(enum setRepresentation repr) { this->repr = repr; }
+
+  // Returns true if the last run() iterated over sparse sets.
+  bool usedSparseSets() { return sparseRun; }
+
+  virtual void meetInto(BitVector &dst, ArrayRef<const BitVector *> inputs) {
+    dst = *inputs[0];
+    for (size_t itr = 1; itr < inputs.size(); ++itr) {
+      Meet::combine(dst, *inputs[itr]);
+    }
+  }
+
+  virtual void transferFn(struct bbProps *props) {
+    int idx = blockIndex[props->ref];
+    if (Dir == FORWARD) {
+      applyTransfer(props->bbOutput, props->bbInput, idx);
+    } else {
+      applyTransfer(props->bbInput, props->bbOutput, idx);
+    }
+  }
+};
+} // namespace llvm
+
+#endif
@@ -0,0 +1,300 @@
+#include "bitset-kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITKERNELS_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace llvm {
+namespace bitkernels {
+
+/* Portable implementation. The SIMD implementations also use these on the
+ * words that do not fill a whole vector register, which is why they operate
+ * on the range [from, to).
+ */
+static bool andNotOrScalar(word *dst, const word *src, const word *kill,
+                           const word *gen, size_t from, size_t to) {
+  word diff = 0;
+  for (size_t w = from; w < to; ++w) {
+    word r = (src[w] & ~kill[w]) | gen[w];
+    diff |= r ^ dst[w];
+    dst[w] = r;
+  }
+  return diff != 0;
+}
+
+static bool orAndNotScalar(word *dst, const word *src, const word *plus,
+                           const word *minus, size_t from, size_t to) {
+  word diff = 0;
+  for (size_t w = from; w < to; ++w) {
+    word r = (src[w] | plus[w]) & ~minus[w];
+    diff |= r ^ dst[w];
+    dst[w] = r;
+  }
+  return diff != 0;
+}
+
+static bool meetIntersectScalar(word *dst, const word *const *srcs,
+                                size_t numSrcs, size_t from, size_t to) {
+  word diff = 0;
+  for (size_t w = from; w < to; ++w) {
+    word r = srcs[0][w];
+    for (size_t j = 1; j < numSrcs; ++j) {
+      r &= srcs[j][w];
+    }
+    diff |= r ^ dst[w];
+    dst[w] = r;
+  }
+  return diff != 0;
+}
+
+static bool meetUnionScalar(word *dst, const word *const *srcs,
+                            size_t numSrcs, size_t from, size_t to) {
+  word diff = 0;
+  for (size_t w = from; w < to; ++w) {
+    word r = srcs[0][w];
+    for (size_t j = 1; j < numSrcs; ++j) {
+      r |= srcs[j][w];
+    }
+    diff |= r ^ dst[w];
+    dst[w] = r;
+  }
+  return diff != 0;
+}
+
+static bool andNotOrScalar(word *dst, const word *src, const word *kill,
+                           const word *gen, size_t numWords) {
+  return andNotOrScalar(dst, src, kill, gen, 0, numWords);
+}
+
+static bool orAndNotScalar(word *dst, const word *src, const word *plus,
+                           const word *minus, size_t numWords) {
+  return orAndNotScalar(dst, src, plus, minus, 0, numWords);
+}
+
+static bool meetIntersectScalar(word *dst, const word *const *srcs,
+                                size_t numSrcs, size_t numWords) {
+  return meetIntersectScalar(dst, srcs, numSrcs, 0, numWords);
+}
+
+static bool meetUnionScalar(word *dst, const word *const *srcs,
+                            size_t numSrcs, size_t numWords) {
+  return meetUnionScalar(dst, srcs, numSrcs, 0, numWords);
+}
+
+#ifdef BITKERNELS_X86
+
+/* SSE2 implementation, 128-bit lanes. SSE2 has no PTEST, so a lane is
+ * checked for being all zeroes with a byte compare and a movemask.
+ */
+static const size_t SSE2_WORDS = sizeof(__m128i) / sizeof(word);
+
+TARGET_SSE2 static inline __m128i load128(const word *p) {
+  return _mm_loadu_si128((const __m128i *)p);
+}
+
+TARGET_SSE2 static inline bool nonZero128(__m128i v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+}
+
+TARGET_SSE2 static bool andNotOrSSE2(word *dst, const word *src,
+                                     const word *kill, const word *gen,
+                                     size_t numWords) {
+  __m128i diff = _mm_setzero_si128();
+  size_t w = 0;
+  for (; w + SSE2_WORDS <= numWords; w += SSE2_WORDS) {
+    __m128i r = _mm_or_si128(_mm_andnot_si128(load128(kill + w), load128(src + w)),
+                             load128(gen + w));
+    diff = _mm_or_si128(diff, _mm_xor_si128(r, load128(dst + w)));
+    _mm_storeu_si128((__m128i *)(dst + w), r);
+  }
+  bool changed = andNotOrScalar(dst, src, kill, gen, w, numWords);
+  return nonZero128(diff) || changed;
+}
+
+TARGET_SSE2 static bool orAndNotSSE2(word *dst, const word *src,
+                                     const word *plus, const word *minus,
+                                     size_t numWords) {
+  __m128i diff = _mm_setzero_si128();
+  size_t w = 0;
+  for (; w + SSE2_WORDS <= numWords; w += SSE2_WORDS) {
+    __m128i r = _mm_andnot_si128(load128(minus + w),
+                                 _mm_or_si128(load128(src + w), load128(plus + w)));
+    diff = _mm_or_si128(diff, _mm_xor_si128(r, load128(dst + w)));
+    _mm_storeu_si128((__m128i *)(dst + w), r);
+  }
+  bool changed = orAndNotScalar(dst, src, plus, minus, w, numWords);
+  return nonZero128(diff) || changed;
+}
+
+TARGET_SSE2 static bool meetIntersectSSE2(word *dst, const word *const *srcs,
+                                          size_t numSrcs, size_t numWords) {
+  __m128i diff = _mm_setzero_si128();
+  size_t w = 0;
+  for (; w + SSE2_WORDS <= numWords; w += SSE2_WORDS) {
+    __m128i r = load128(srcs[0] + w);
+    for (size_t j = 1; j < numSrcs; ++j) {
+      r = _mm_and_si128(r, load128(srcs[j] + w));
+    }
+    diff = _mm_or_si128(diff, _mm_xor_si128(r, load128(dst + w)));
+    _mm_storeu_si128((__m128i *)(dst + w), r);
+  }
+  bool changed = meetIntersectScalar(dst, srcs, numSrcs, w, numWords);
+  return nonZero128(diff) || changed;
+}
+
+TARGET_SSE2 static bool meetUnionSSE2(word *dst, const word *const *srcs,
+                                      size_t numSrcs, size_t numWords) {
+  __m128i diff = _mm_setzero_si128();
+  size_t w = 0;
+  for (; w + SSE2_WORDS <= numWords; w += SSE2_WORDS) {
+    __m128i r = load128(srcs[0] + w);
+    for (size_t j = 1; j < numSrcs; ++j) {
+      r = _mm_or_si128(r, load128(srcs[j] + w));
+    }
+    diff = _mm_or_si128(diff, _mm_xor_si128(r, load128(dst + w)));
+    _mm_storeu_si128((__m128i *)(dst + w), r);
+  }
+  bool changed = meetUnionScalar(dst, srcs, numSrcs, w, numWords);
+  return nonZero128(diff) || changed;
+}
+
+// AVX2 implementation, 256-bit lanes.
+static const size_t AVX2_WORDS = sizeof(__m256i) / sizeof(word);
+
+TARGET_AVX2 static inline __m256i load256(const word *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+
+TARGET_AVX2 static bool andNotOrAVX2(word *dst, const word *src,
+                                     const word *kill, const word *gen,
+                                     size_t numWords) {
+  __m256i diff = _mm256_setzero_si256();
+  size_t w = 0;
+  for (; w + AVX2_WORDS <= numWords; w += AVX2_WORDS) {
+    __m256i r = _mm256_or_si256(
+        _mm256_andnot_si256(load256(kill + w), load256(src + w)),
+        load256(gen + w));
+    diff = _mm256_or_si256(diff, _mm256_xor_si256(r, load256(dst + w)));
+    _mm256_storeu_si256((__m256i *)(dst + w), r);
+  }
+  bool changed = andNotOrScalar(dst, src, kill, gen, w, numWords);
+  return !_mm256_testz_si256(diff, diff) || changed;
+}
+
+TARGET_AVX2 static bool orAndNotAVX2(word *dst, const word *src,
+                                     const word *plus, const word *minus,
+                                     size_t numWords) {
+  __m256i diff = _mm256_setzero_si256();
+  size_t w = 0;
+  for (; w + AVX2_WORDS <= numWords; w += AVX2_WORDS) {
+    __m256i r = _mm256_andnot_si256(
+        load256(minus + w), _mm256_or_si256(load256(src + w), load256(plus + w)));
+    diff = _mm256_or_si256(diff, _mm256_xor_si256(r, load256(dst + w)));
+    _mm256_storeu_si256((__m256i *)(dst + w), r);
+  }
+  bool changed = orAndNotScalar(dst, src, plus, minus, w, numWords);
+  return !_mm256_testz_si256(diff, diff) || changed;
+}
+
+TARGET_AVX2 static bool meetIntersectAVX2(word *dst, const word *const *srcs,
+                                          size_t numSrcs, size_t numWords) {
+  __m256i diff = _mm256_setzero_si256();
+  size_t w = 0;
+  for (; w + AVX2_WORDS <= numWords; w += AVX2_WORDS) {
+    __m256i r = load256(srcs[0] + w);
+    for (size_t j = 1; j < numSrcs; ++j) {
+      r = _mm256_and_si256(r, load256(srcs[j] + w));
+    }
+    diff = _mm256_or_si256(diff, _mm256_xor_si256(r, load256(dst + w)));
+    _mm256_storeu_si256((__m256i *)(dst + w), r);
+  }
+  bool changed = meetIntersectScalar(dst, srcs, numSrcs, w, numWords);
+  return !_mm256_testz_si256(diff, diff) || changed;
+}
+
+TARGET_AVX2 static bool meetUnionAVX2(word *dst, const word *const *srcs,
+                                      size_t numSrcs, size_t numWords) {
+  __m256i diff = _mm256_setzero_si256();
+  size_t w = 0;
+  for (; w + AVX2_WORDS <= numWords; w += AVX2_WORDS) {
+    __m256i r = load256(srcs[0] + w);
+    for (size_t j = 1; j < numSrcs; ++j) {
+      r = _mm256_or_si256(r, load256(srcs[j] + w));
+    }
+    diff = _mm256_or_si256(diff, _mm256_xor_si256(r, load256(dst + w)));
+    _mm256_storeu_si256((__m256i *)(dst + w), r);
+  }
+  bool changed = meetUnionScalar(dst, srcs, numSrcs, w, numWords);
+  return !_mm256_testz_si256(diff, diff) || changed;
+}
+#endif // BITKERNELS_X86
+
+// Dispatch table, filled in for the selected implementation.
+struct kernelTable {
+  enum isaLevel level;
+  const char *name;
+  bool (*andNotOr)(word *, const word *, const word *, const word *, size_t);
+  bool (*orAndNot)(word *, const word *, const word *, const word *, size_t);
+  bool (*meetIntersect)(word *, const word *const *, size_t, size_t);
+  bool (*meetUnion)(word *, const word *const *, size_t, size_t);
+};
+
+static const kernelTable scalarTable = {SCALAR,         "scalar",
+                                        andNotOrScalar, orAndNotScalar,
+                                        meetIntersectScalar, meetUnionScalar};
+
+#ifdef BITKERNELS_X86
+static const kernelTable sse2Table = {SSE2,         "sse2",
+                                      andNotOrSSE2, orAndNotSSE2,
+                                      meetIntersectSSE2, meetUnionSSE2};
+
+static const kernelTable avx2Table = {AVX2,         "avx2",
+                                      andNotOrAVX2, orAndNotAVX2,
+                                      meetIntersectAVX2, meetUnionAVX2};
+#endif
+
+// Returns the table for the best implementation at or below level that the
+// CPU supports.
+static const kernelTable *selectTable(enum isaLevel level) {
+#ifdef BITKERNELS_X86
+  __builtin_cpu_init();
+  if (level >= AVX2 && __builtin_cpu_supports("avx2"))
+    return &avx2Table;
+  if (level >= SSE2 && __builtin_cpu_supports("sse2"))
+    return &sse2Table;
+#endif
+  return &scalarTable;
+}
+
+static const kernelTable *table = selectTable(AVX2);
+
+enum isaLevel getISALevel() { return table->level; }
+
+const char *getISAName() { return table->name; }
+
+void setISALevel(enum isaLevel level) { table = selectTable(level); }
+
+bool andNotOr(word *dst, const word *src, const word *kill, const word *gen,
+              size_t numWords) {
+  return table->andNotOr(dst, src, kill, gen, numWords);
+}
+
+bool orAndNot(word *dst, const word *src, const word *plus, const word *minus,
+              size_t numWords) {
+  return table->orAndNot(dst, src, plus, minus, numWords);
+}
+
+bool meetIntersect(word *dst, const word *const *srcs, size_t numSrcs,
+                   size_t numWords) {
+  return table->meetIntersect(dst, srcs, numSrcs, numWords);
+}
+
+bool meetUnion(word *dst, const word *const *srcs, size_t numSrcs,
+               size_t numWords) {
+  return table->meetUnion(dst, srcs, numSrcs, numWords);
+}
+} // namespace bitkernels
+} // namespace llvm
@@ -1,7 +1,23 @@
 #include "dataflow.h"
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/Support/Timer.h"
+
+#define DEBUG_TYPE "dataflow"
+
 using namespace std;
 
+STATISTIC(NumRuns, "Number of dataflow analyses run");
+STATISTIC(NumSweeps, "Number of sweeps over the blocks of a function");
+STATISTIC(NumVisits, "Number of block visits");
+STATISTIC(NumBitsChanged, "Number of bits changed in propagated states");
+STATISTIC(NumCapped, "Number of analyses stopped at the iteration cap");
+STATISTIC(NumBytes, "Number of bytes allocated for per-block state");
+
+static const char *const TimerGroupName = "dataflow";
+static const char *const TimerGroupDesc = "Dataflow framework";
+
 namespace llvm {
 
 /* This function initializes the post-order and reverse post-order traversal
@@ -23,14 +39,53 @@ void Dataflow::populateTraversal(Function &F) {
   }
 }
 
-// Initializes the predecessors and successors for a given block.
-void Dataflow::populateEdges(BasicBlock *BB, struct bbProps *props) {
-  for (BasicBlock *predBlocks : predecessors(BB)) {
-    props->pBlocks.push_back(predBlocks);
+/* Assigns every BasicBlock a dense block number. Reachable blocks are numbered
+ * in reverse post-order, so that block i of a Forward pass is visited before
+ * block i+1, and a Backward pass simply walks the numbers in reverse. Blocks
+ * that are unreachable from the entry are numbered last, and are never visited.
+ */
+void Dataflow::numberBlocks(Function &F) {
+  for (BasicBlock *BB : rpoTraversal) {
+    blockIndex[BB] = blockRefs.size();
+    blockRefs.push_back(BB);
   }
-  for (BasicBlock *succBlocks : successors(BB)) {
-    props->sBlocks.push_back(succBlocks);
+  numReachable = blockRefs.size();
+
+  for (BasicBlock &BB : F) {
+    if (blockIndex.find(&BB) == blockIndex.end()) {
+      blockIndex[&BB] = blockRefs.size();
+      blockRefs.push_back(&BB);
+    }
   }
+  numBlocks = blockRefs.size();
+}
+
+// Initializes the predecessor and successor lists of every block, as block
+// numbers in compressed sparse row form.
+void Dataflow::populateEdges() {
+  predStart.reserve(numBlocks + 1);
+  succStart.reserve(numBlocks + 1);
+
+  for (BasicBlock *BB : blockRefs) {
+    predStart.push_back(predList.size());
+    for (BasicBlock *predBlocks : predecessors(BB)) {
+      predList.push_back(blockIndex[predBlocks]);
+    }
+    succStart.push_back(succList.size());
+    for (BasicBlock *succBlocks : successors(BB)) {
+      succList.push_back(blockIndex[succBlocks]);
+    }
+  }
+  predStart.push_back(predList.size());
+  succStart.push_back(succList.size());
+
+  // Size the meet scratch list for the block with the most neighbours.
+  maxDegree = 0;
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    maxDegree = std::max(maxDegree, predStart[idx + 1] - predStart[idx]);
+    maxDegree = std::max(maxDegree, succStart[idx + 1] - succStart[idx]);
+  }
+  meetInputs.reserve(maxDegree);
 }
 
 // Initializes the input and output BitVector of each basic block, depending on
@@ -48,53 +103,102 @@ void Dataflow::initializeBlocks(struct bbProps *block) {
 }
 
 /* This function is used to initialize the entire state of the Dataflow object.
- * This involves creating an entry for each BasicBlock in the result map. We
- * also initialize the bbProps struct associated with each BasicBlock, with the
- * help of the info map provided by the client. We initialize the predecessors
- * and successors of each block, and assign the boundary and initial conditions.
+ * This involves numbering each BasicBlock, determining its type, and building
+ * the predecessor and successor lists. The per-block state is then set up by
+ * initializeState.
  */
 void Dataflow::initialize(Function &F,
-                          map<BasicBlock *, struct bbInfo *> infoMap) {
-  BitVector empty(domainSize, false); // Empty Set
+                          const map<BasicBlock *, struct bbInfo *> &infoMap) {
+  numberBlocks(F);
 
-  for (BasicBlock &BB : F) {
-    struct bbProps *props = new bbProps();
-    props->ref = &BB;
-    props->bbInput = empty;
-    props->bbOutput = empty;
-
-    // Set GenSet and KillSet
-    struct bbInfo *info = infoMap[&BB];
-    props->genSet = info->genSet;
-    props->killSet = info->killSet;
-
-    // Initialize predecessors and successors for each BasicBlock
-    populateEdges(&BB, props);
-
-    // Determine block type - <ENTRY, EXIT, REGULAR>
-    if (&BB == &F.getEntryBlock()) {
-      props->type = ENTRY;
-    } else {
-      props->type = REGULAR;
+  // Determine block type - <ENTRY, EXIT, REGULAR>
+  blockTypes.assign(numBlocks, REGULAR);
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    BasicBlock *BB = blockRefs[idx];
+    if (BB == &F.getEntryBlock()) {
+      blockTypes[idx] = ENTRY;
     }
-    for (Instruction &II : BB) {
+    for (Instruction &II : *BB) {
       Instruction *I = &II;
       if (isa<ReturnInst>(I)) {
-        props->type = EXIT;
+        blockTypes[idx] = EXIT;
       }
     }
-    result[&BB] = props;
   }
 
-  map<BasicBlock *, struct bbProps *>::iterator it = result.begin();
-  struct bbProps *blk;
+  // Initialize predecessors and successors for each BasicBlock
+  populateEdges();
+
+  initializeState(infoMap);
+}
+
+/* Allocates the state of each block in the per-block arrays. We initialize the
+ * gen and kill sets of each block with the help of the info map provided by
+ * the client, and assign the boundary and initial conditions.
+ */
+void Dataflow::initializeState(
+    const map<BasicBlock *, struct bbInfo *> &infoMap) {
+  BitVector empty(domainSize, false); // Empty Set
+
+  inputs.assign(numBlocks, empty);
+  outputs.assign(numBlocks, empty);
+  genSets.assign(numBlocks, empty);
+  killSets.assign(numBlocks, empty);
+
+  // Set GenSet and KillSet. Blocks that the client did not describe keep
+  // empty sets.
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    auto info = infoMap.find(blockRefs[idx]);
+    if (info != infoMap.end()) {
+      genSets[idx] = info->second->genSet;
+      killSets[idx] = info->second->killSet;
+    }
+  }
+  prevState = empty;
+
+  // The per-block arrays are never resized after this point, so the handles
+  // can safely refer into them.
+  props.reserve(numBlocks);
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    props.push_back({blockTypes[idx], blockRefs[idx], inputs[idx],
+                     outputs[idx], genSets[idx], killSets[idx]});
+  }
 
   // Set initial and boundary conditions for each BasicBlock
-  while (it != result.end()) {
-    blk = result[it->first];
-    initializeBlocks(blk);
-    ++it;
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    initializeBlocks(&props[idx]);
+  }
+}
+
+static unsigned long bytesOf(const BitVector &B) {
+  return B.getMemorySize();
+}
+
+template <typename T> static unsigned long bytesOf(const vector<T> &V) {
+  return V.capacity() * sizeof(T);
+}
+
+// Heap footprint of the per-block state and edge lists.
+unsigned long Dataflow::stateBytes() const {
+  unsigned long bytes = bytesOf(blockRefs) + bytesOf(blockTypes) +
+                        bytesOf(props) + blockIndex.getMemorySize();
+  for (const vector<BitVector> *sets :
+       {&inputs, &outputs, &genSets, &killSets}) {
+    bytes += bytesOf(*sets);
+    for (const BitVector &B : *sets) {
+      bytes += bytesOf(B);
+    }
   }
+  bytes += bytesOf(predStart) + bytesOf(predList) + bytesOf(succStart) +
+           bytesOf(succList) + bytesOf(meetInputs) + bytesOf(prevState);
+  return bytes;
+}
+
+// Counts an allocation if B had to move to a new buffer since `before` was
+// taken.
+void Dataflow::trackAllocation(const BitVector &B, const void *before) {
+  if (storageOf(B) != before)
+    ++steadyStateAllocations;
 }
 
 void Dataflow::displayVector(BitVector b) {
@@ -104,84 +208,123 @@ void Dataflow::displayVector(BitVector b) {
   }
 }
 
-void Dataflow::run(Function &F, map<BasicBlock *, struct bbInfo *> infoMap) {
-  bool converged = false;
-  map<BasicBlock *, BitVector> prevOutput;
-  map<BasicBlock *, BitVector> prevInput;
-
-  initialize(F, infoMap);
-  populateTraversal(F);
-
-  int iter = 0;
-  vector<BasicBlock *> traversal =
-      (dir == FORWARD) ? rpoTraversal : poTraversal;
-
-  int iterations = 5;
-  // Begin Dataflow iteration.
-  while (!converged) {
-    for (BasicBlock *BB : traversal) {
-      prevInput[BB] = result[BB]->bbInput;   // Collect previous outputs of each
-                                             // block before iterating.
-      prevOutput[BB] = result[BB]->bbOutput; // Collect previous outputs of each
-                                             // block before iterating.
-      vector<BitVector> meetInputs;
-
-      // Collect inputs for the meet function, based on the pass direction. If
-      // it is a Forward pass, the output of predecessor blocks will be treated
-      // as inputs to the meet function. If it is a Backward pass, the input of
-      // successor blocks will be treated as inputs to the meet function.
-      if (dir == FORWARD) {
-        for (BasicBlock *p : result[BB]->pBlocks) {
-          meetInputs.push_back(result[p]->bbOutput);
-        }
-      } else if (dir == BACKWARD) {
-        for (BasicBlock *s : result[BB]->sBlocks) {
-          meetInputs.push_back(result[s]->bbInput);
-        }
-      }
+/* Adapter for analyses that only implement the legacy meetFn. The inputs are
+ * copied into a fresh vector, and the returned BitVector is copied into dst.
+ */
+void Dataflow::meetInto(BitVector &dst, ArrayRef<const BitVector *> inputs) {
+  vector<BitVector> copies;
+  for (const BitVector *in : inputs) {
+    copies.push_back(*in);
+  }
+  dst = meetFn(copies);
 
-      if (!meetInputs.empty()) {
-        BitVector meet = meetFn(meetInputs);
+  // One allocation for the vector, one per copied input, and one for the
+  // returned BitVector.
+  steadyStateAllocations += inputs.size() + 2;
+}
 
-        // Based on the Pass direction, the output of the meet function is
-        // assigned to either BasicBlock's input or output.
-        if (dir == FORWARD) {
-          result[BB]->bbInput = meet;
-        } else if (dir == BACKWARD) {
-          result[BB]->bbOutput = meet;
-        }
-      }
+BitVector Dataflow::meetFn(vector<BitVector> /* input */) {
+  llvm_unreachable("Dataflow analyses must override meetInto or meetFn");
+}
 
-      // Apply the trasnfer function to the block.
-      transferFn(result[BB]);
-    }
+/* Applies the meet and transfer functions to a single block. Returns the
+ * number of bits that changed in the value this block propagates to its
+ * neighbours, i.e. the output for a Forward pass, or the input for a Backward
+ * pass.
+ */
+unsigned Dataflow::processBlock(int idx) {
+  BitVector &propagated = (dir == FORWARD) ? outputs[idx] : inputs[idx];
+  BitVector &meet = (dir == FORWARD) ? inputs[idx] : outputs[idx];
+  const void *prevStorage = storageOf(prevState);
+  const void *propagatedStorage = storageOf(propagated);
+  const void *meetStorage = storageOf(meet);
 
-    // Check if the algorithm has converged, by comparing the values of all
-    // previous outputs, and the current outputs.
-    converged = true;
-    if (dir == BACKWARD) {
-      for (map<BasicBlock *, BitVector>::iterator it = prevInput.begin();
-           it != prevInput.end(); ++it) {
-        if ((result[it->first]->bbInput) != it->second) {
-          converged = false;
-          break;
-        }
-      }
-    } else {
-      for (map<BasicBlock *, BitVector>::iterator it = prevOutput.begin();
-           it != prevOutput.end(); ++it) {
-        if ((result[it->first]->bbOutput) != it->second) {
-          converged = false;
-          break;
-        }
-      }
+  prevState = propagated;
+
+  // Collect inputs for the meet function, based on the pass direction. If
+  // it is a Forward pass, the output of predecessor blocks will be treated
+  // as inputs to the meet function. If it is a Backward pass, the input of
+  // successor blocks will be treated as inputs to the meet function.
+  meetInputs.clear();
+  if (dir == FORWARD) {
+    for (int e = predStart[idx]; e < predStart[idx + 1]; ++e) {
+      meetInputs.push_back(&outputs[predList[e]]);
     }
+  } else if (dir == BACKWARD) {
+    for (int e = succStart[idx]; e < succStart[idx + 1]; ++e) {
+      meetInputs.push_back(&inputs[succList[e]]);
+    }
+  }
+
+  // Based on the Pass direction, the output of the meet function is
+  // assigned to either BasicBlock's input or output.
+  if (!meetInputs.empty()) {
+    meetInto(meet, meetInputs);
+  }
+
+  // Apply the trasnfer function to the block.
+  transferFn(&props[idx]);
+
+  trackAllocation(prevState, prevStorage);
+  trackAllocation(propagated, propagatedStorage);
+  trackAllocation(meet, meetStorage);
+
+  prevState ^= propagated;
+  return prevState.count();
+}
+
+unsigned Dataflow::iterationCap() const {
+  return maxIterations ? maxIterations : numReachable + 2;
+}
+
+// Emits a warning for a run that stopped at the iteration cap.
+void Dataflow::reportCap(Function &F) {
+  ++NumCapped;
+  F.getContext().diagnose(DiagnosticInfoOptimizationFailure(
+      F, DiagnosticLocation(F.getSubprogram()),
+      "dataflow analysis of '" + F.getName() + "' stopped after " +
+          Twine(metrics.sweeps) +
+          " sweeps without reaching a fixed point; its results are "
+          "incomplete"));
+}
+
+void Dataflow::solve() {
+  auto visit = [this](int idx) { return processBlock(idx); };
+  if (mode == WORKLIST) {
+    runWorklist(visit);
+  } else {
+    runSweep(visit);
+  }
+}
+
+void Dataflow::run(Function &F,
+                   const map<BasicBlock *, struct bbInfo *> &infoMap) {
+  metrics = {0, 0, 0, 0, false};
+
+  {
+    NamedRegionTimer T("initialize", "Dataflow initialization", TimerGroupName,
+                       TimerGroupDesc, TimePassesIsEnabled);
+    populateTraversal(F);
+    initialize(F, infoMap);
+  }
+  metrics.bytesAllocated = stateBytes();
+
+  {
+    NamedRegionTimer T("solve", "Dataflow fixed-point iteration",
+                       TimerGroupName, TimerGroupDesc, TimePassesIsEnabled);
+    solve();
+  }
+
+  ++NumRuns;
+  NumBytes += metrics.bytesAllocated;
+  NumSweeps += metrics.sweeps;
+  NumVisits += metrics.visits;
+  NumBitsChanged += metrics.bitsChanged;
+  if (!metrics.converged)
+    reportCap(F);
 
-    ++iter;
-    --iterations;
-    if (iterations == 0)
-      break;
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    result[blockRefs[idx]] = &props[idx];
   }
-  // outs() << "DFA converged after " << iter << " iterations\n";
 }
-} // namespace llvm
\ No newline at end of file
+} // namespace llvm
@@ -0,0 +1,97 @@
+#include "pass-stats.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Timer.h"
+
+#include <stdlib.h>
+
+using namespace std;
+
+namespace llvm {
+
+static double wallClock() {
+  return TimeRecord::getCurrentTime(true).getWallTime();
+}
+
+PassStats::PassStats(StringRef passName, Function &F)
+    : PassStats(passName, F, nullptr) {}
+
+PassStats::PassStats(StringRef passName, Function &F, BasicBlock *loopHeader) {
+  this->passName = passName.str();
+  this->functionName = F.getName().str();
+  if (loopHeader)
+    this->loopName = loopHeader->getName().str();
+  this->startTime = wallClock();
+  this->analyses = 0;
+  this->sweeps = 0;
+  this->visits = 0;
+  this->bitsChanged = 0;
+  this->bytesAllocated = 0;
+  this->domainSize = 0;
+  this->converged = true;
+}
+
+PassStats::~PassStats() {
+  double wallTime = getElapsed();
+  if (const char *path = getenv("DATAFLOW_STATS_JSON")) {
+    if (*path)
+      writeJSON(path, wallTime);
+  }
+}
+
+void PassStats::addAnalysis(Dataflow &dfa) {
+  const struct dataflowMetrics &metrics = dfa.getMetrics();
+  ++analyses;
+  sweeps += metrics.sweeps;
+  visits += metrics.visits;
+  bitsChanged += metrics.bitsChanged;
+  bytesAllocated += metrics.bytesAllocated;
+  domainSize = std::max(domainSize, dfa.getDomainSize());
+  converged &= metrics.converged;
+}
+
+void PassStats::addTransform(StringRef kind, unsigned long count) {
+  for (auto &transform : transforms) {
+    if (transform.first == kind) {
+      transform.second += count;
+      return;
+    }
+  }
+  transforms.push_back(make_pair(kind.str(), count));
+}
+
+double PassStats::getElapsed() const { return wallClock() - startTime; }
+
+// Appends this record to the file at path, as a single line of JSON.
+void PassStats::writeJSON(StringRef path, double wallTime) {
+  std::error_code EC;
+  raw_fd_ostream out(path, EC, sys::fs::OF_Append | sys::fs::OF_Text);
+  if (EC) {
+    errs() << "Could not open " << path << ": " << EC.message() << "\n";
+    return;
+  }
+
+  json::OStream J(out);
+  J.object([&] {
+    J.attribute("pass", passName);
+    J.attribute("function", functionName);
+    if (!loopName.empty())
+      J.attribute("loop", loopName);
+    J.attribute("wall_time_ms", wallTime * 1000);
+    J.attribute("analyses", (int64_t)analyses);
+    J.attribute("iterations", (int64_t)sweeps);
+    J.attribute("blocks_visited", (int64_t)visits);
+    J.attribute("bits_changed", (int64_t)bitsChanged);
+    J.attribute("domain_size", domainSize);
+    J.attribute("bytes_allocated", (int64_t)bytesAllocated);
+    J.attribute("converged", converged);
+    J.attributeObject("transforms", [&] {
+      for (auto &transform : transforms) {
+        J.attribute(transform.first, (int64_t)transform.second);
+      }
+    });
+  });
+  out << "\n";
+}
+} // namespace llvm
@@ -0,0 +1,73 @@
+#ifndef __CONTROL_DEPENDENCE_H__
+#define __CONTROL_DEPENDENCE_H__
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+
+#include "dom-tree.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace llvm {
+
+/**
+ * @brief ControlDependence is the control-dependence graph of a function,
+ * built from the post-dominance frontiers of a post-dominator DomTree. A block
+ * B is control dependent on a block A if A has a successor that B
+ * post-dominates, but B does not strictly post-dominate A, i.e. the branch at
+ * the end of A decides whether B executes. Those are exactly the blocks A in
+ * the post-dominance frontier of B.
+ *
+ * Blocks are identified by their ID in the post-dominator tree it was built
+ * from, which must stay alive, and unchanged, for as long as the graph is
+ * queried. Both directions of the graph are stored in compressed sparse row
+ * form, sorted by ID. Blocks that are not control dependent on any block, e.g.
+ * the entry block, run whenever the function does and reaches an exit.
+ */
+class ControlDependence {
+protected:
+  const DomTree *postDomTree; // Tree the graph was built from
+
+  // Blocks each block is control dependent on, i.e. its post-dominance
+  // frontier, and the blocks control dependent on each block.
+  vector<int> dependsStart;
+  vector<int> dependsList;
+  vector<int> dependentStart;
+  vector<int> dependentList;
+
+public:
+  ControlDependence();
+
+  // Builds the graph from postDomTree, discarding any previous result.
+  void recalculate(const DomTree &postDomTree);
+
+  // Blocks that block id is control dependent on, as IDs.
+  ArrayRef<int> dependsOn(int id) const {
+    return makeArrayRef(dependsList)
+        .slice(dependsStart[id], dependsStart[id + 1] - dependsStart[id]);
+  }
+
+  // Blocks that are control dependent on block id, as IDs.
+  ArrayRef<int> dependents(int id) const {
+    return makeArrayRef(dependentList)
+        .slice(dependentStart[id], dependentStart[id + 1] - dependentStart[id]);
+  }
+
+  // Returns true if B is control dependent on A.
+  bool isControlDependent(BasicBlock *B, BasicBlock *A) const;
+
+  // Appends the blocks BB is control dependent on to deps.
+  void getDependsOn(BasicBlock *BB, SmallVectorImpl<BasicBlock *> &deps) const;
+
+  // Appends the blocks that are control dependent on BB to deps.
+  void getDependents(BasicBlock *BB,
+                     SmallVectorImpl<BasicBlock *> &deps) const;
+
+  const DomTree &getPostDomTree() const { return *postDomTree; }
+};
+} // namespace llvm
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef __DOM_TREE_H__
+#define __DOM_TREE_H__
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace llvm {
+
+// enum to denote the kind of a CFG update
+enum cfgUpdateKind {
+  INSERT_EDGE = 0,
+  DELETE_EDGE = 1,
+};
+
+// An edge that was inserted into, or deleted from, the CFG.
+struct CFGUpdate {
+  enum cfgUpdateKind kind;
+  BasicBlock *from;
+  BasicBlock *to;
+};
+
+/**
+ * @brief DomTree computes the immediate dominator of every BasicBlock with the
+ * iterative algorithm of Cooper, Harvey and Kennedy ("A Simple, Fast Dominance
+ * Algorithm"). Blocks are numbered in reverse post-order, and the idom of each
+ * block is refined by intersecting the dominator tree paths of its processed
+ * predecessors, walking up the idom array by RPO number, until no idom
+ * changes. Only an idom array is stored, instead of a set of dominators per
+ * block.
+ *
+ * Once the idoms are known, the tree is numbered in depth-first order, so that
+ * A dominates B exactly when the [in, out] interval of A contains the one of B.
+ * This makes dominates() a constant time query.
+ *
+ * Blocks that are unreachable from the entry are not part of the tree. Like
+ * LLVM's DominatorTree, they are dominated by every block, and dominate none.
+ *
+ * Queries can be made by BasicBlock, or by block ID. The ID of a block is its
+ * RPO number, from 0 for the entry to size() - 1, so that clients can keep
+ * their own per-block state in dense arrays. Lists are returned as views into
+ * the tree's own storage, which stay valid until the next recalculate() or
+ * applyUpdates().
+ *
+ * Dominance frontiers are computed on the first query that needs them, with
+ * the algorithm of Cooper, Harvey and Kennedy: for each join block, walk up
+ * the tree from each predecessor until its idom is reached. They are cached
+ * until the next recalculate().
+ *
+ * A DomTree constructed with postDom set computes post-dominators instead, by
+ * running the same algorithm on the reverse CFG. Its root, ID 0, is a virtual
+ * exit node with no BasicBlock (getBlock(0) is nullptr), whose successors in
+ * the reverse CFG are all blocks without successors, so that functions with
+ * several returns have a single root. Blocks that cannot reach any exit, e.g.
+ * those of an infinite loop, are attached to the virtual exit as well: for
+ * each such region, the first of its blocks in post-order becomes an extra
+ * root. Every block of the function is then part of the post-dominator tree,
+ * and the frontier of a block is its post-dominance frontier, i.e. the blocks
+ * it is control dependent on.
+ *
+ * Passes that change the CFG can keep the tree up to date with applyUpdates(),
+ * instead of recalculating it. Each update is an edge inserted into, or
+ * deleted from, the CFG, and a batch must list them in the order they were
+ * made, once all of them are done. New blocks are added to the tree through
+ * the edges that reach them. The tree is repaired incrementally, in the style
+ * of the dynamic SNCA algorithm: an inserted edge moves the affected blocks up
+ * to the nearest common dominator of its ends, and a deleted edge rebuilds only
+ * the subtree of that dominator. After a batch, blocks are numbered in
+ * pre-order of the tree, instead of in reverse post-order of the CFG, so that
+ * every block is still numbered after its idom. Post-dominator trees are
+ * recalculated instead.
+ */
+class DomTree {
+protected:
+  bool postDom;  // Post-dominators, computed on the reverse CFG
+  Function *func; // Function the tree was computed for
+
+  /* Block numbering. Reachable blocks are numbered in reverse post-order, so
+   * the root is 0, and every block is numbered after its idom. After updates,
+   * they are numbered in pre-order of the tree instead. For
+   * post-dominators, the order is the one of the reverse CFG, and block 0 is
+   * the virtual exit.
+   */
+  int numBlocks;                          // Number of reachable blocks
+  DenseMap<BasicBlock *, int> blockIndex; // BasicBlock to block number
+  vector<BasicBlock *> blockRefs;         // Block number to BasicBlock
+
+  // Predecessors and successors of each block as block numbers, without
+  // duplicates. This is the tree's own view of the CFG, which follows the
+  // updates. Unreachable blocks are left out. For post-dominators, these are
+  // the edges of the reverse CFG, with the virtual exit before the roots.
+  vector<SmallVector<int, 2>> preds;
+  vector<SmallVector<int, 2>> succs;
+
+  vector<int> idoms; // Immediate dominator by block number, idoms[0] = 0
+
+  // Children of each block in the dominator tree, in compressed sparse row
+  // form, and the depth-first interval of each block.
+  vector<int> childStart;
+  vector<int> childList;
+  vector<int> dfsIn;
+  vector<int> dfsOut;
+  vector<int> levels; // Depth of each block in the tree, 0 for the root
+
+  // Children of each block during a batch of updates, when the tree changes.
+  vector<SmallVector<int, 4>> kids;
+
+  unsigned iterations; // Passes over the blocks until the idoms converged
+
+  // Dominance frontier of each block, in compressed sparse row form, sorted by
+  // block number. Only valid if frontiersValid is set.
+  mutable vector<int> frontierStart;
+  mutable vector<int> frontierList;
+  mutable bool frontiersValid;
+
+  void numberBlocks(Function &F);
+  void numberBlocksReverse(Function &F);
+  bool addEdge(int a, int b);
+  bool removeEdge(int a, int b);
+  static unsigned solveIdoms(const vector<SmallVector<int, 2>> &preds,
+                             vector<int> &idoms);
+  void computeIdoms();
+  int intersect(int finger1, int finger2) const;
+  void buildTree();
+  void computeFrontiers() const;
+
+  bool inTree(int id) const { return id == 0 || idoms[id] != -1; }
+  int addBlock(BasicBlock *BB);
+  void setIdom(int id, int parent);
+  void updateLevels(int id);
+  int nearestCommonDominatorByLevel(int a, int b) const;
+  void insertEdge(BasicBlock *From, BasicBlock *To);
+  void insertReachable(int from, int to);
+  void insertUnreachable(int from, BasicBlock *To);
+  void deleteEdge(BasicBlock *From, BasicBlock *To);
+  void deleteUnreachable(int to);
+  void rebuildSubtree(int root);
+  void finishUpdates();
+
+public:
+  DomTree(bool postDom = false);
+
+  // Computes the (post-)dominator tree of F, discarding any previous result.
+  void recalculate(Function &F);
+
+  // Brings the tree up to date with a batch of CFG updates, made to the
+  // function it was computed for, in order.
+  void applyUpdates(ArrayRef<CFGUpdate> updates);
+
+  // Returns true if the tree matches one recalculated from the CFG.
+  bool verify() const;
+
+  // Returns true if this tree holds post-dominators.
+  bool isPostDominator() const { return postDom; }
+
+  // Number of blocks in the tree, i.e. blocks reachable from the entry, or
+  // every block plus the virtual exit for post-dominators.
+  int size() const { return numBlocks; }
+
+  // Returns the ID of BB, or -1 if BB is unreachable.
+  int getBlockId(BasicBlock *BB) const {
+    auto itr = blockIndex.find(BB);
+    return itr == blockIndex.end() ? -1 : itr->second;
+  }
+
+  // Returns the BasicBlock of block id, or nullptr for the virtual exit.
+  BasicBlock *getBlock(int id) const { return blockRefs[id]; }
+
+  // All blocks of the tree, by ID, i.e. in reverse post-order, or in
+  // pre-order of the tree after updates. For
+  // post-dominators, the first one is the virtual exit, i.e. nullptr.
+  ArrayRef<BasicBlock *> blocks() const { return blockRefs; }
+
+  // Returns true if BB is reachable from the entry block, i.e. part of the
+  // tree. Always true for post-dominators.
+  bool isReachable(BasicBlock *BB) const { return getBlockId(BB) != -1; }
+
+  // Returns true if A dominates B. Every block dominates itself.
+  bool dominates(BasicBlock *A, BasicBlock *B) const;
+  bool dominates(int a, int b) const {
+    return dfsIn[a] <= dfsIn[b] && dfsOut[b] <= dfsOut[a];
+  }
+
+  // Returns true if A dominates B, and A is not B.
+  bool properlyDominates(BasicBlock *A, BasicBlock *B) const {
+    return A != B && dominates(A, B);
+  }
+
+  // Returns the immediate dominator of BB, or nullptr for the entry block and
+  // for unreachable blocks. For post-dominators, nullptr stands for the
+  // virtual exit.
+  BasicBlock *getIdom(BasicBlock *BB) const;
+
+  // Returns the ID of the immediate dominator of block id, or -1 for the
+  // root.
+  int getIdom(int id) const { return id == 0 ? -1 : idoms[id]; }
+
+  // Depth of block id in the tree, 0 for the root.
+  int getLevel(int id) const { return levels[id]; }
+
+  // Children of block id in the dominator tree, as IDs.
+  ArrayRef<int> children(int id) const {
+    return makeArrayRef(childList).slice(childStart[id],
+                                         childStart[id + 1] - childStart[id]);
+  }
+
+  // Returns the deepest block in the tree that dominates both A and B, or
+  // nullptr if either of them is unreachable, or if it is the virtual exit.
+  BasicBlock *nearestCommonDominator(BasicBlock *A, BasicBlock *B) const;
+  int nearestCommonDominator(int a, int b) const { return intersect(a, b); }
+
+  // Position of block id in a depth-first walk of the tree. A dominates B iff
+  // in(A) <= in(B) and out(B) <= out(A).
+  int getDFSIn(int id) const { return dfsIn[id]; }
+  int getDFSOut(int id) const { return dfsOut[id]; }
+
+  // Dominance frontier of block id, as IDs in increasing order.
+  ArrayRef<int> frontier(int id) const {
+    if (!frontiersValid)
+      computeFrontiers();
+    return makeArrayRef(frontierList)
+        .slice(frontierStart[id], frontierStart[id + 1] - frontierStart[id]);
+  }
+
+  /* Iterated dominance frontier DF+ of a set of blocks, i.e. the blocks where
+   * a phi is needed to merge values defined in defs. The result is appended
+   * to idf as IDs in increasing order. Unreachable blocks in defs are ignored.
+   */
+  void iteratedFrontier(ArrayRef<int> defs, SmallVectorImpl<int> &idf) const;
+  void iteratedFrontier(ArrayRef<BasicBlock *> defs,
+                        SmallVectorImpl<BasicBlock *> &idf) const;
+
+  // Number of passes the iterative algorithm needed to converge.
+  unsigned getIterations() const { return iterations; }
+};
+} // namespace llvm
+
+#endif
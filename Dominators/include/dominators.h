@@ -4,7 +4,10 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "control-dependence.h"
 #include "dataflow.h"
+#include "dom-tree.h"
+#include "pass-stats.h"
 
 #include <map>
 #include <set>
@@ -14,6 +17,14 @@ using namespace llvm;
 using namespace std;
 
 namespace llvm {
+
+// enum to denote the algorithm used to compute dominators
+enum domEngine {
+  BITVECTOR_ENGINE = 0, // Dominator sets, as a Dataflow analysis
+  CHK_ENGINE = 1,       // Immediate dominators, Cooper-Harvey-Kennedy
+  CHECK_ENGINE = 2,     // Both, reporting any block where they disagree
+};
+
 /**
  * @brief Dominators class is an implementation of the Dominator Dataflow
  * Analysis Pass. It traverses the Control flow graph in post-order fashion, and
@@ -21,6 +32,15 @@ namespace llvm {
  * dominating Y (denoted as x dom y), if there is no path from ENTRY to Y, that
  * does not go through X.
  *
+ * The dominator tree is computed directly by DomTree, and queried through
+ * getDomTree(). The original bit-vector analysis can still be selected with
+ * -dom-engine=bitvector, in which case the dominator sets and the printed
+ * results come from it, or run alongside DomTree to cross-check it with
+ * -dom-engine=check.
+ *
+ * The post-dominator tree and the control-dependence graph are computed with
+ * the same algorithm on the reverse CFG, on the first request after each run,
+ * and cached until the pass runs again.
  */
 class Dominators : public FunctionPass {
 public:
@@ -31,9 +51,43 @@ public:
 
   /**
    * @brief API to be used by other LLVM Passes, to request dominator
-   * information. The result is returned in the form of map<string,
-   * set<string>>, where the key is the name of the BasicBlock, and the value is
-   * the set of names of all dominators of the key.
+   * information. Queries are keyed by BasicBlock* or by dense block ID, and
+   * run in constant time, e.g.
+   * getAnalysis<Dominators>().getDomTree().dominates(A, B)
+   *
+   * @return const DomTree& The dominator tree of the last function the pass
+   * ran on.
+   */
+  const DomTree &getDomTree() { return domTree; }
+
+  /**
+   * @brief API to request post-dominator information, e.g.
+   * getAnalysis<Dominators>().getPostDomTree().dominates(A, B), which is true
+   * if A post-dominates B. Block 0 of the tree is a virtual exit, that
+   * post-dominates every block.
+   *
+   * @return const DomTree& The post-dominator tree of the last function the
+   * pass ran on.
+   */
+  const DomTree &getPostDomTree();
+
+  /**
+   * @brief API to request control dependences, e.g.
+   * getAnalysis<Dominators>().getControlDependence().dependsOn(id), which
+   * lists the branch blocks that decide whether block id executes. IDs are the
+   * ones of getPostDomTree().
+   *
+   * @return const ControlDependence& The control-dependence graph of the last
+   * function the pass ran on.
+   */
+  const ControlDependence &getControlDependence();
+
+  /**
+   * @brief Debugging view of the dominator information, in the form of
+   * map<string, set<string>>, where the key is the name of the BasicBlock, and
+   * the value is the set of names of all dominators of the key. It is built
+   * from the dominator tree on the first call, and requires every block to
+   * have a unique name.
    *
    * @return map<string, set<string>> Returns domMap, a map where the key is the
    * name of the BasicBlock, and the value is the set of names of all dominators
@@ -41,7 +95,18 @@ public:
    */
   map<string, set<string>> getDomMap();
 
+  // Selects the algorithm used by runOnFunction.
+  void setEngine(enum domEngine engine) { this->engine = engine; }
+
 private:
+  enum domEngine engine; // Algorithm used to compute dominators
+  DomTree domTree;       // Dominator tree of currFunction
+  Function *currFunction; // Function the pass last ran on
+
+  DomTree postDomTree;           // Post-dominator tree of currFunction
+  ControlDependence controlDeps; // Control dependences of currFunction
+  bool postDomValid;             // postDomTree and controlDeps are computed
+
   // Map of BasicBlock name and its position in the BitVectors.
   map<BasicBlock *, struct bbInfo *> infoMap;
   // Map of BasicBlock name and their position in the BitVector.
@@ -54,6 +119,10 @@ private:
 
   void populateInfoMap(Function &F, vector<string> domain);
   void generateDomMap(map<BasicBlock *, struct bbProps *>);
+  void generateDomMap(Function &F, const DomTree &tree);
+  string getName(BasicBlock *BB);
+  void runBitVectorEngine(Function &F, PassStats &stats);
+  bool crossCheck(Function &F);
   bool contains(set<string> set1, set<string> set2);
   bool isSubset(string key, set<string> smallSet, set<string> bigSet);
   string getImmediateDominator(string basicBlock);
@@ -68,7 +137,8 @@ private:
         : Dataflow(domainSize, dir, boundaryCond, initCond) {}
 
     virtual void transferFn(struct bbProps *props);
-    virtual BitVector meetFn(vector<BitVector> inputs);
+    virtual void meetInto(BitVector &dst,
+                          ArrayRef<const BitVector *> inputs);
   };
 };
 } // namespace llvm
\ No newline at end of file
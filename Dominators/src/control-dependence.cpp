@@ -0,0 +1,71 @@
+#include "control-dependence.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace llvm {
+
+ControlDependence::ControlDependence() { this->postDomTree = nullptr; }
+
+/* The forward edges are the post-dominance frontiers, copied from the tree.
+ * The reverse edges are filled by counting sort, so that both directions stay
+ * sorted by ID.
+ */
+void ControlDependence::recalculate(const DomTree &postDomTree) {
+  this->postDomTree = &postDomTree;
+  int numBlocks = postDomTree.size();
+
+  dependsStart.clear();
+  dependsList.clear();
+  dependentStart.assign(numBlocks + 1, 0);
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    dependsStart.push_back(dependsList.size());
+    for (int branch : postDomTree.frontier(idx)) {
+      dependsList.push_back(branch);
+      ++dependentStart[branch + 1];
+    }
+  }
+  dependsStart.push_back(dependsList.size());
+
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    dependentStart[idx + 1] += dependentStart[idx];
+  }
+  dependentList.assign(dependsList.size(), 0);
+  vector<int> fill(dependentStart.begin(), dependentStart.end() - 1);
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    for (int branch : dependsOn(idx)) {
+      dependentList[fill[branch]++] = idx;
+    }
+  }
+}
+
+bool ControlDependence::isControlDependent(BasicBlock *B,
+                                           BasicBlock *A) const {
+  int a = postDomTree->getBlockId(A), b = postDomTree->getBlockId(B);
+  if (a == -1 || b == -1)
+    return false;
+  ArrayRef<int> deps = dependsOn(b);
+  return binary_search(deps.begin(), deps.end(), a);
+}
+
+void ControlDependence::getDependsOn(
+    BasicBlock *BB, SmallVectorImpl<BasicBlock *> &deps) const {
+  int id = postDomTree->getBlockId(BB);
+  if (id == -1)
+    return;
+  for (int branch : dependsOn(id)) {
+    deps.push_back(postDomTree->getBlock(branch));
+  }
+}
+
+void ControlDependence::getDependents(
+    BasicBlock *BB, SmallVectorImpl<BasicBlock *> &deps) const {
+  int id = postDomTree->getBlockId(BB);
+  if (id == -1)
+    return;
+  for (int dependent : dependents(id)) {
+    deps.push_back(postDomTree->getBlock(dependent));
+  }
+}
+} // namespace llvm
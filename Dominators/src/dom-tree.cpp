@@ -0,0 +1,752 @@
+#include "dom-tree.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
+#include <queue>
+
+using namespace std;
+
+namespace llvm {
+
+DomTree::DomTree(bool postDom) {
+  this->postDom = postDom;
+  this->func = nullptr;
+  this->numBlocks = 0;
+  this->iterations = 0;
+  this->frontiersValid = false;
+}
+
+// Numbers the reachable blocks of F in reverse post-order, and collects their
+// edges.
+void DomTree::numberBlocks(Function &F) {
+  blockIndex.clear();
+  blockRefs.clear();
+
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *BB : RPOT) {
+    blockIndex[BB] = blockRefs.size();
+    blockRefs.push_back(BB);
+  }
+  numBlocks = blockRefs.size();
+
+  preds.assign(numBlocks, {});
+  succs.assign(numBlocks, {});
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    for (BasicBlock *succ : successors(blockRefs[idx])) {
+      addEdge(idx, blockIndex[succ]);
+    }
+  }
+}
+
+/* Numbers the blocks of F in reverse post-order of the reverse CFG, after the
+ * virtual exit 0, and collects the edges of the reverse CFG. The walk
+ * starts from the virtual exit, whose successors are the blocks without
+ * successors. Blocks it does not reach cannot reach an exit. They are visited
+ * in forward post-order, so that the first one of each region found is a block
+ * whose successors are all visited already, or in the same region, e.g. the
+ * latch of an infinite loop. That block is attached to the virtual exit as an
+ * extra root, and the walk continues from it.
+ */
+void DomTree::numberBlocksReverse(Function &F) {
+  blockIndex.clear();
+  blockRefs.clear();
+
+  vector<BasicBlock *> candidates;
+  SmallPtrSet<BasicBlock *, 4> roots; // Extra roots
+  for (BasicBlock &BB : F) {
+    if (succ_empty(&BB))
+      candidates.push_back(&BB);
+  }
+  int numExits = candidates.size();
+  for (BasicBlock *BB : post_order(&F)) {
+    candidates.push_back(BB);
+  }
+  for (BasicBlock &BB : F) {
+    candidates.push_back(&BB);
+  }
+
+  // Iterative depth-first walk over predecessors, where each stack entry holds
+  // the block and the position of its next predecessor to visit.
+  SmallPtrSet<BasicBlock *, 32> visited;
+  vector<BasicBlock *> postOrder;
+  vector<pair<BasicBlock *, pred_iterator>> stack;
+  for (int pos = 0; pos < (int)candidates.size(); ++pos) {
+    BasicBlock *root = candidates[pos];
+    if (visited.count(root))
+      continue;
+    // Past the real exits, every root is one of the extra ones.
+    if (pos >= numExits)
+      roots.insert(root);
+    visited.insert(root);
+    stack.push_back({root, pred_begin(root)});
+    while (!stack.empty()) {
+      BasicBlock *BB = stack.back().first;
+      pred_iterator &next = stack.back().second;
+      if (next == pred_end(BB)) {
+        postOrder.push_back(BB);
+        stack.pop_back();
+        continue;
+      }
+      BasicBlock *pred = *next++;
+      if (visited.insert(pred).second) {
+        stack.push_back({pred, pred_begin(pred)});
+      }
+    }
+  }
+
+  blockRefs.push_back(nullptr);
+  for (auto itr = postOrder.rbegin(); itr != postOrder.rend(); ++itr) {
+    blockIndex[*itr] = blockRefs.size();
+    blockRefs.push_back(*itr);
+  }
+  numBlocks = blockRefs.size();
+
+  preds.assign(numBlocks, {});
+  succs.assign(numBlocks, {});
+  for (int idx = 1; idx < numBlocks; ++idx) {
+    BasicBlock *BB = blockRefs[idx];
+    for (BasicBlock *succ : successors(BB)) {
+      addEdge(blockIndex[succ], idx);
+    }
+    if (succ_empty(BB) || roots.count(BB))
+      addEdge(0, idx);
+  }
+}
+
+// Adds the edge from a to b, unless it is already there. Returns true if it
+// was added.
+bool DomTree::addEdge(int a, int b) {
+  if (is_contained(succs[a], b))
+    return false;
+  succs[a].push_back(b);
+  preds[b].push_back(a);
+  return true;
+}
+
+// Removes the edge from a to b. Returns true if it was there.
+bool DomTree::removeEdge(int a, int b) {
+  auto itr = find(succs[a], b);
+  if (itr == succs[a].end())
+    return false;
+  succs[a].erase(itr);
+  preds[b].erase(find(preds[b], a));
+  return true;
+}
+
+/* Walks the two fingers up the tree until they meet. Since the root is
+ * numbered 0 and every block is numbered after its idom, the finger with the
+ * larger number is always the one that is further from the root.
+ */
+static int intersect(const vector<int> &idoms, int finger1, int finger2) {
+  while (finger1 != finger2) {
+    while (finger1 > finger2)
+      finger1 = idoms[finger1];
+    while (finger2 > finger1)
+      finger2 = idoms[finger2];
+  }
+  return finger1;
+}
+
+int DomTree::intersect(int finger1, int finger2) const {
+  return llvm::intersect(idoms, finger1, finger2);
+}
+
+/* The Cooper-Harvey-Kennedy iteration, on a graph whose nodes are numbered in
+ * RPO from the root 0, given by the predecessors of each node. Nodes are
+ * processed in RPO, so on the first pass every node except loop headers has
+ * all of its predecessors processed, and acyclic graphs converge in a single
+ * pass. Returns the number of passes.
+ */
+unsigned DomTree::solveIdoms(const vector<SmallVector<int, 2>> &preds,
+                             vector<int> &idoms) {
+  int size = preds.size();
+  idoms.assign(size, -1);
+  if (size == 0)
+    return 0;
+  idoms[0] = 0;
+
+  unsigned passes = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    ++passes;
+
+    for (int idx = 1; idx < size; ++idx) {
+      int newIdom = -1;
+      for (int pred : preds[idx]) {
+        // Skip predecessors that have not been processed yet.
+        if (idoms[pred] == -1)
+          continue;
+        newIdom = (newIdom == -1) ? pred : llvm::intersect(idoms, pred, newIdom);
+      }
+
+      if (idoms[idx] != newIdom) {
+        idoms[idx] = newIdom;
+        changed = true;
+      }
+    }
+  }
+  return passes;
+}
+
+void DomTree::computeIdoms() { iterations = solveIdoms(preds, idoms); }
+
+// Builds the children lists of the tree, and numbers it in depth-first order.
+// The depth of each block is recorded as its level.
+void DomTree::buildTree() {
+  childStart.assign(numBlocks + 1, 0);
+  childList.assign(numBlocks > 0 ? numBlocks - 1 : 0, 0);
+  for (int idx = 1; idx < numBlocks; ++idx) {
+    ++childStart[idoms[idx] + 1];
+  }
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    childStart[idx + 1] += childStart[idx];
+  }
+  vector<int> fill(childStart.begin(), childStart.end() - 1);
+  for (int idx = 1; idx < numBlocks; ++idx) {
+    childList[fill[idoms[idx]]++] = idx;
+  }
+
+  dfsIn.assign(numBlocks, 0);
+  dfsOut.assign(numBlocks, 0);
+  levels.assign(numBlocks, 0);
+  if (numBlocks == 0)
+    return;
+
+  // Iterative depth-first walk, where next[idx] is the position of the next
+  // child of idx to visit.
+  vector<int> stack;
+  vector<int> next(childStart.begin(), childStart.end() - 1);
+  int counter = 0;
+  stack.push_back(0);
+  dfsIn[0] = counter++;
+  while (!stack.empty()) {
+    int idx = stack.back();
+    if (next[idx] == childStart[idx + 1]) {
+      dfsOut[idx] = counter++;
+      stack.pop_back();
+      continue;
+    }
+    int child = childList[next[idx]++];
+    dfsIn[child] = counter++;
+    levels[child] = levels[idx] + 1;
+    stack.push_back(child);
+  }
+}
+
+void DomTree::recalculate(Function &F) {
+  func = &F;
+  if (postDom)
+    numberBlocksReverse(F);
+  else
+    numberBlocks(F);
+  computeIdoms();
+  buildTree();
+  frontiersValid = false;
+}
+
+/* A block is in the dominance frontier of every block that dominates one of
+ * its predecessors, but not the block itself. Those are exactly the blocks on
+ * the tree path from each predecessor up to, and excluding, the idom of the
+ * join block. Only blocks with several predecessors can be in a frontier.
+ */
+void DomTree::computeFrontiers() const {
+  vector<vector<int>> frontiers(numBlocks);
+  for (int idx = 1; idx < numBlocks; ++idx) {
+    if (preds[idx].size() < 2)
+      continue;
+    for (int runner : preds[idx]) {
+      while (runner != idoms[idx]) {
+        // Each join block is added to a frontier at most once, and join
+        // blocks are visited in increasing order, so the lists stay sorted.
+        if (frontiers[runner].empty() || frontiers[runner].back() != idx)
+          frontiers[runner].push_back(idx);
+        if (runner == 0)
+          break;
+        runner = idoms[runner];
+      }
+    }
+  }
+
+  frontierStart.clear();
+  frontierList.clear();
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    frontierStart.push_back(frontierList.size());
+    frontierList.insert(frontierList.end(), frontiers[idx].begin(),
+                        frontiers[idx].end());
+  }
+  frontierStart.push_back(frontierList.size());
+  frontiersValid = true;
+}
+
+void DomTree::iteratedFrontier(ArrayRef<int> defs,
+                               SmallVectorImpl<int> &idf) const {
+  vector<bool> inIDF(numBlocks, false);
+  vector<bool> queued(numBlocks, false);
+  vector<int> worklist;
+  for (int def : defs) {
+    if (def >= 0 && !queued[def]) {
+      queued[def] = true;
+      worklist.push_back(def);
+    }
+  }
+
+  // A block that is added to DF+ merges values itself, so its own frontier
+  // is part of DF+ as well.
+  while (!worklist.empty()) {
+    int idx = worklist.back();
+    worklist.pop_back();
+    for (int join : frontier(idx)) {
+      if (inIDF[join])
+        continue;
+      inIDF[join] = true;
+      if (!queued[join]) {
+        queued[join] = true;
+        worklist.push_back(join);
+      }
+    }
+  }
+
+  for (int idx = 0; idx < numBlocks; ++idx) {
+    if (inIDF[idx])
+      idf.push_back(idx);
+  }
+}
+
+void DomTree::iteratedFrontier(ArrayRef<BasicBlock *> defs,
+                               SmallVectorImpl<BasicBlock *> &idf) const {
+  SmallVector<int, 8> ids, idfIds;
+  for (BasicBlock *BB : defs) {
+    ids.push_back(getBlockId(BB));
+  }
+  iteratedFrontier(ids, idfIds);
+  for (int id : idfIds) {
+    idf.push_back(blockRefs[id]);
+  }
+}
+
+/* Incremental updates, after the dynamic SNCA algorithm of Georgiadis et al.
+ * ("An Experimental Study of Dynamic Dominators"), as in LLVM's
+ * DominatorTree. During a batch, the tree is kept as idoms, levels and dynamic
+ * children lists, and the edges as the tree's own view of the CFG, which
+ * follows the updates one at a time. Block IDs stay the same during a batch,
+ * new blocks are given the next ones, and finishUpdates() renumbers the tree
+ * at the end.
+ */
+void DomTree::applyUpdates(ArrayRef<CFGUpdate> updates) {
+  if (updates.empty() || !func)
+    return;
+  if (postDom || numBlocks == 0) {
+    recalculate(*func);
+    return;
+  }
+
+  kids.assign(numBlocks, {});
+  for (int idx = 1; idx < numBlocks; ++idx) {
+    kids[idoms[idx]].push_back(idx);
+  }
+
+  for (const CFGUpdate &update : updates) {
+    if (update.kind == INSERT_EDGE)
+      insertEdge(update.from, update.to);
+    else
+      deleteEdge(update.from, update.to);
+  }
+  finishUpdates();
+}
+
+// Gives BB the next block ID, outside of the tree.
+int DomTree::addBlock(BasicBlock *BB) {
+  int id = blockRefs.size();
+  blockIndex[BB] = id;
+  blockRefs.push_back(BB);
+  idoms.push_back(-1);
+  levels.push_back(0);
+  preds.emplace_back();
+  succs.emplace_back();
+  kids.emplace_back();
+  numBlocks = blockRefs.size();
+  return id;
+}
+
+// Makes parent the idom of block id, in the children lists as well.
+void DomTree::setIdom(int id, int parent) {
+  if (idoms[id] != -1) {
+    SmallVector<int, 4> &siblings = kids[idoms[id]];
+    siblings.erase(find(siblings, id));
+  }
+  idoms[id] = parent;
+  kids[parent].push_back(id);
+}
+
+// Sets the levels of the subtree of block id from its own.
+void DomTree::updateLevels(int id) {
+  SmallVector<int, 8> stack;
+  stack.push_back(id);
+  while (!stack.empty()) {
+    int idx = stack.pop_back_val();
+    for (int child : kids[idx]) {
+      levels[child] = levels[idx] + 1;
+      stack.push_back(child);
+    }
+  }
+}
+
+// Nearest common dominator during a batch, when IDs are not ordered by the
+// tree, by walking up from the deeper block.
+int DomTree::nearestCommonDominatorByLevel(int a, int b) const {
+  while (a != b) {
+    if (levels[a] < levels[b])
+      swap(a, b);
+    a = idoms[a];
+  }
+  return a;
+}
+
+void DomTree::insertEdge(BasicBlock *From, BasicBlock *To) {
+  // Edges of blocks outside of the tree are read from the CFG once they are
+  // reached.
+  int from = getBlockId(From);
+  if (from == -1 || !inTree(from))
+    return;
+  int to = getBlockId(To);
+  if (to == -1 || !inTree(to)) {
+    insertUnreachable(from, To);
+    return;
+  }
+  if (addEdge(from, to))
+    insertReachable(from, to);
+}
+
+/* An edge from `from` to `to` can only lower the idom of blocks to the nearest
+ * common dominator of `from` and `to`, and only if they are deeper in the tree
+ * than it. The affected blocks are found by walking down from `to`, deepest
+ * first, and all of them become children of the nearest common dominator.
+ */
+void DomTree::insertReachable(int from, int to) {
+  int nca = nearestCommonDominatorByLevel(from, to);
+  if (nca == to || nca == idoms[to])
+    return;
+  int ncaLevel = levels[nca];
+
+  priority_queue<pair<int, int>> bucket; // Affected blocks, by level
+  DenseSet<int> visited;
+  SmallVector<int, 8> affected;
+  bucket.push({levels[to], to});
+  visited.insert(to);
+  while (!bucket.empty()) {
+    int root = bucket.top().second;
+    bucket.pop();
+    affected.push_back(root);
+
+    // Blocks below the root are reached through it, and are not affected
+    // themselves. Blocks at its level or above are, if they are deeper than
+    // the children of the nearest common dominator.
+    int rootLevel = levels[root];
+    SmallVector<int, 8> stack;
+    stack.push_back(root);
+    while (!stack.empty()) {
+      int idx = stack.pop_back_val();
+      for (int succ : succs[idx]) {
+        if (levels[succ] <= ncaLevel + 1 || !visited.insert(succ).second)
+          continue;
+        if (levels[succ] > rootLevel)
+          stack.push_back(succ);
+        else
+          bucket.push({levels[succ], succ});
+      }
+    }
+  }
+
+  for (int idx : affected) {
+    setIdom(idx, nca);
+    levels[idx] = ncaLevel + 1;
+    updateLevels(idx);
+  }
+}
+
+/* The edge makes To, and the blocks only reachable through it, part of the
+ * tree. Their edges are read from the CFG, their idoms are computed with the
+ * Cooper-Harvey-Kennedy iteration on the region, rooted at `from`, and the
+ * edges from the region into the rest of the tree are then inserted.
+ */
+void DomTree::insertUnreachable(int from, BasicBlock *To) {
+  SmallVector<int, 8> postOrder;
+  SmallVector<pair<int, int>, 8> connecting; // Edges into the tree
+  vector<pair<int, succ_iterator>> stack;
+
+  int to = getBlockId(To);
+  if (to == -1)
+    to = addBlock(To);
+  DenseMap<int, int> local; // Block ID to number in the region
+  local[to] = -1;
+  stack.push_back({to, succ_begin(To)});
+  while (!stack.empty()) {
+    int idx = stack.back().first;
+    succ_iterator &next = stack.back().second;
+    if (next == succ_end(blockRefs[idx])) {
+      postOrder.push_back(idx);
+      stack.pop_back();
+      continue;
+    }
+    BasicBlock *Succ = *next++;
+    int succ = getBlockId(Succ);
+    if (succ != -1 && inTree(succ)) {
+      connecting.push_back({idx, succ});
+      continue;
+    }
+    if (succ == -1)
+      succ = addBlock(Succ);
+    addEdge(idx, succ);
+    if (local.insert({succ, -1}).second)
+      stack.push_back({succ, succ_begin(Succ)});
+  }
+  addEdge(from, to);
+
+  // Number the region in RPO after `from`, and solve it.
+  vector<int> region;
+  region.push_back(from);
+  for (auto itr = postOrder.rbegin(); itr != postOrder.rend(); ++itr) {
+    local[*itr] = region.size();
+    region.push_back(*itr);
+  }
+  vector<SmallVector<int, 2>> regionPreds(region.size());
+  for (int pos = 1; pos < (int)region.size(); ++pos) {
+    for (int pred : preds[region[pos]]) {
+      if (pred == from)
+        regionPreds[pos].push_back(0);
+      else
+        regionPreds[pos].push_back(local[pred]);
+    }
+  }
+  vector<int> regionIdoms;
+  solveIdoms(regionPreds, regionIdoms);
+  for (int pos = 1; pos < (int)region.size(); ++pos) {
+    int idom = region[regionIdoms[pos]];
+    setIdom(region[pos], idom);
+    levels[region[pos]] = levels[idom] + 1;
+  }
+
+  for (auto &edge : connecting) {
+    if (addEdge(edge.first, edge.second))
+      insertReachable(edge.first, edge.second);
+  }
+}
+
+/* Deleting an edge from `from` to `to` can only change the idoms of blocks
+ * dominated by their nearest common dominator, unless `to` dominates `from`,
+ * or `to` is no longer reachable. That subtree is rebuilt.
+ */
+void DomTree::deleteEdge(BasicBlock *From, BasicBlock *To) {
+  int from = getBlockId(From), to = getBlockId(To);
+  if (from == -1 || to == -1 || !removeEdge(from, to))
+    return;
+  int nca = nearestCommonDominatorByLevel(from, to);
+  if (nca == to)
+    return;
+
+  // `to` is still reachable if `from` was not its idom, or if it has another
+  // predecessor that it does not dominate.
+  bool reachable = from != idoms[to];
+  for (int pred : preds[to]) {
+    if (reachable)
+      break;
+    reachable = nearestCommonDominatorByLevel(to, pred) != to;
+  }
+  if (reachable)
+    rebuildSubtree(nca);
+  else
+    deleteUnreachable(to);
+}
+
+/* When `to` is no longer reachable, neither are the blocks of its subtree,
+ * except for those that can be reached another way, and the blocks its
+ * subtree has edges to may lose paths as well. Those are the blocks at the
+ * level of `to` or above that are reachable from it, and the tree is rebuilt
+ * from the highest of their nearest common dominators with `to`.
+ */
+void DomTree::deleteUnreachable(int to) {
+  int toLevel = levels[to];
+  int top = idoms[to];
+  SmallVector<int, 16> stack;
+  DenseSet<int> visited;
+  stack.push_back(to);
+  visited.insert(to);
+  while (!stack.empty()) {
+    int idx = stack.pop_back_val();
+    for (int succ : succs[idx]) {
+      if (!visited.insert(succ).second)
+        continue;
+      if (levels[succ] > toLevel) {
+        stack.push_back(succ);
+        continue;
+      }
+      int nca = nearestCommonDominatorByLevel(succ, to);
+      if (nca != succ && levels[nca] < levels[top])
+        top = nca;
+    }
+  }
+  rebuildSubtree(top);
+}
+
+/* Recomputes the idoms of the blocks dominated by root with the
+ * Cooper-Harvey-Kennedy iteration, on the blocks of its subtree that it still
+ * reaches. A path from root to one of them cannot leave the subtree, since its
+ * blocks would then not be dominated by root. The blocks it no longer reaches
+ * are unreachable, and are taken out of the tree with their edges.
+ */
+void DomTree::rebuildSubtree(int root) {
+  // Blocks of the subtree, mapped to their number in RPO from root.
+  DenseMap<int, int> local;
+  SmallVector<int, 16> members;
+  members.push_back(root);
+  for (int pos = 0; pos < (int)members.size(); ++pos) {
+    local[members[pos]] = -1;
+    members.append(kids[members[pos]].begin(), kids[members[pos]].end());
+  }
+
+  SmallVector<int, 16> postOrder;
+  vector<pair<int, int>> stack; // Block, and position of its next successor
+  DenseSet<int> visited;
+  visited.insert(root);
+  stack.push_back({root, 0});
+  while (!stack.empty()) {
+    int idx = stack.back().first;
+    int &next = stack.back().second;
+    if (next == (int)succs[idx].size()) {
+      postOrder.push_back(idx);
+      stack.pop_back();
+      continue;
+    }
+    int succ = succs[idx][next++];
+    if (local.count(succ) && visited.insert(succ).second)
+      stack.push_back({succ, 0});
+  }
+
+  vector<int> subtree;
+  for (auto itr = postOrder.rbegin(); itr != postOrder.rend(); ++itr) {
+    local[*itr] = subtree.size();
+    subtree.push_back(*itr);
+  }
+  vector<SmallVector<int, 2>> subtreePreds(subtree.size());
+  for (int pos = 1; pos < (int)subtree.size(); ++pos) {
+    for (int pred : preds[subtree[pos]]) {
+      auto itr = local.find(pred);
+      if (itr != local.end() && itr->second != -1)
+        subtreePreds[pos].push_back(itr->second);
+    }
+  }
+  vector<int> subtreeIdoms;
+  solveIdoms(subtreePreds, subtreeIdoms);
+
+  for (int idx : members) {
+    kids[idx].clear();
+    if (local[idx] != -1)
+      continue;
+    // No longer reachable.
+    idoms[idx] = -1;
+    for (int succ : succs[idx]) {
+      preds[succ].erase(find(preds[succ], idx));
+    }
+    for (int pred : preds[idx]) {
+      succs[pred].erase(find(succs[pred], idx));
+    }
+    succs[idx].clear();
+    preds[idx].clear();
+  }
+  for (int pos = 1; pos < (int)subtree.size(); ++pos) {
+    int idom = subtree[subtreeIdoms[pos]];
+    idoms[subtree[pos]] = idom;
+    kids[idom].push_back(subtree[pos]);
+    levels[subtree[pos]] = levels[idom] + 1;
+  }
+}
+
+/* Renumbers the tree in pre-order, so that every block is still numbered after
+ * its idom, and drops the blocks that are no longer part of it.
+ */
+void DomTree::finishUpdates() {
+  vector<int> order;
+  vector<int> newId(numBlocks, -1);
+  SmallVector<int, 16> stack;
+  stack.push_back(0);
+  while (!stack.empty()) {
+    int idx = stack.pop_back_val();
+    newId[idx] = order.size();
+    order.push_back(idx);
+    for (auto itr = kids[idx].rbegin(); itr != kids[idx].rend(); ++itr) {
+      stack.push_back(*itr);
+    }
+  }
+  kids.clear();
+
+  int size = order.size();
+  vector<BasicBlock *> newRefs(size);
+  vector<int> newIdoms(size);
+  vector<SmallVector<int, 2>> newPreds(size), newSuccs(size);
+  blockIndex.clear();
+  for (int pos = 0; pos < size; ++pos) {
+    int idx = order[pos];
+    newRefs[pos] = blockRefs[idx];
+    blockIndex[blockRefs[idx]] = pos;
+    newIdoms[pos] = pos == 0 ? 0 : newId[idoms[idx]];
+    for (int pred : preds[idx]) {
+      newPreds[pos].push_back(newId[pred]);
+    }
+    for (int succ : succs[idx]) {
+      newSuccs[pos].push_back(newId[succ]);
+    }
+  }
+  blockRefs.swap(newRefs);
+  idoms.swap(newIdoms);
+  preds.swap(newPreds);
+  succs.swap(newSuccs);
+  numBlocks = size;
+
+  buildTree();
+  frontiersValid = false;
+}
+
+// Compares the tree with one computed from scratch, by BasicBlock.
+bool DomTree::verify() const {
+  if (!func)
+    return true;
+  DomTree fresh(postDom);
+  fresh.recalculate(*func);
+  if (fresh.size() != size())
+    return false;
+  for (BasicBlock *BB : fresh.blocks()) {
+    if (BB && (getBlockId(BB) == -1 || fresh.getIdom(BB) != getIdom(BB)))
+      return false;
+  }
+  return true;
+}
+
+bool DomTree::dominates(BasicBlock *A, BasicBlock *B) const {
+  int b = getBlockId(B);
+  if (b == -1)
+    return true;
+  int a = getBlockId(A);
+  if (a == -1)
+    return false;
+  return dominates(a, b);
+}
+
+BasicBlock *DomTree::getIdom(BasicBlock *BB) const {
+  int id = getBlockId(BB);
+  if (id <= 0)
+    return nullptr;
+  return blockRefs[idoms[id]];
+}
+
+BasicBlock *DomTree::nearestCommonDominator(BasicBlock *A,
+                                            BasicBlock *B) const {
+  int a = getBlockId(A), b = getBlockId(B);
+  if (a == -1 || b == -1)
+    return nullptr;
+  return blockRefs[intersect(a, b)];
+}
+} // namespace llvm
@@ -4,18 +4,60 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "dominators.h"
+#include "pass-stats.h"
+
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 using namespace std;
 
+static cl::opt<enum domEngine> DomEngine(
+    "dom-engine", cl::desc("Algorithm used by the dominators pass"),
+    cl::init(CHK_ENGINE),
+    cl::values(clEnumValN(BITVECTOR_ENGINE, "bitvector",
+                          "Dominator sets, as a dataflow analysis"),
+               clEnumValN(CHK_ENGINE, "chk",
+                          "Cooper-Harvey-Kennedy dominator tree"),
+               clEnumValN(CHECK_ENGINE, "check",
+                          "Both, reporting any disagreement")));
+
 namespace llvm {
 
-Dominators::Dominators() : FunctionPass(ID) {}
+Dominators::Dominators() : FunctionPass(ID), postDomTree(true) {
+  this->engine = DomEngine;
+  this->currFunction = nullptr;
+  this->postDomValid = false;
+}
 
 // Overriden function from FunctionPass. Runs for each function encountered
 // during the LLVM Pass.
 bool Dominators::runOnFunction(Function &F) {
+  PassStats stats("dominators", F);
+  currFunction = &F;
+  domMap.clear();
+  postDomValid = false;
+
+  domTree.recalculate(F);
+  stats.addTransform("idom_iterations", domTree.getIterations());
+
+  if (engine != CHK_ENGINE) {
+    runBitVectorEngine(F, stats);
+  }
+
+  if (engine == CHECK_ENGINE && !crossCheck(F)) {
+    report_fatal_error("dominators: engines disagree on function " +
+                       F.getName());
+  }
+
+  // Print the Immediate Dominators of each BasicBlock in a loop.
+  printResults();
 
+  // Does not modify the CFG.
+  return false;
+}
+
+// Computes the dominator sets of F with the Dataflow framework.
+void Dominators::runBitVectorEngine(Function &F, PassStats &stats) {
   vector<string> domain; // Holds the list of all BasicBlock names.
   for (BasicBlock &BB : F) {
     domain.push_back(BB.getName().str());
@@ -34,15 +76,44 @@ bool Dominators::runOnFunction(Function &F) {
   // Run the Dataflow Analysis algorithm on the given function, for the given
   // info map.
   dfa->run(F, infoMap);
+  stats.addAnalysis(*dfa);
 
   // Transform the Dataflow Result into a dominator map.
   generateDomMap(dfa->result);
+}
 
-  // Print the Immediate Dominators of each BasicBlock in a loop.
-  printResults();
+/* Checks the dominator sets computed by the bit-vector analysis against the
+ * dominator tree, for every pair of blocks of F. Disagreements are printed to
+ * stderr. Returns true if there are none.
+ */
+bool Dominators::crossCheck(Function &F) {
+  bool agree = true;
+  for (BasicBlock &A : F) {
+    for (BasicBlock &B : F) {
+      bool inSet = domMap[B.getName().str()].count(A.getName().str()) > 0;
+      if (inSet != domTree.dominates(&A, &B)) {
+        errs() << "dominators: " << A.getName()
+               << (inSet ? " dominates " : " does not dominate ") << B.getName()
+               << " in the bit-vector result only\n";
+        agree = false;
+      }
+    }
+  }
+  return agree;
+}
 
-  // Does not modify the CFG.
-  return false;
+const DomTree &Dominators::getPostDomTree() {
+  if (!postDomValid && currFunction) {
+    postDomTree.recalculate(*currFunction);
+    controlDeps.recalculate(postDomTree);
+    postDomValid = true;
+  }
+  return postDomTree;
+}
+
+const ControlDependence &Dominators::getControlDependence() {
+  getPostDomTree();
+  return controlDeps;
 }
 
 void Dominators::getAnalysisUsage(AnalysisUsage &AU) const {
@@ -58,9 +129,15 @@ void Dominators::printResults() {
   for (Loop *loop : loop_info) {
     outs() << "Loop " << ct << " :\n";
     for (BasicBlock *bb : loop->getBlocksVector()) {
-      outs() << "Basic Block : " << bb->getName() << "\n";
-      outs() << "Immediate Dominator : "
-             << getImmediateDominator(bb->getName().str()) << "\n";
+      outs() << "Basic Block : " << getName(bb) << "\n";
+      if (engine == BITVECTOR_ENGINE) {
+        outs() << "Immediate Dominator : "
+               << getImmediateDominator(bb->getName().str()) << "\n";
+      } else {
+        BasicBlock *idom = domTree.getIdom(bb);
+        outs() << "Immediate Dominator : " << (idom ? getName(idom) : "")
+               << "\n";
+      }
       outs() << "\n";
     }
     ++ct;
@@ -143,7 +220,42 @@ void Dominators::populateInfoMap(Function &F, vector<string> domain) {
   }
 }
 
-map<string, set<string>> Dominators::getDomMap() { return this->domMap; }
+map<string, set<string>> Dominators::getDomMap() {
+  if (domMap.empty() && currFunction)
+    generateDomMap(*currFunction, domTree);
+  return this->domMap;
+}
+
+// Name of BB, for printing. Unnamed blocks are printed as operands, e.g. %3.
+string Dominators::getName(BasicBlock *BB) {
+  if (BB->hasName())
+    return BB->getName().str();
+  string name;
+  raw_string_ostream out(name);
+  BB->printAsOperand(out, false);
+  return out.str();
+}
+
+// Derives the dominator sets of every block from the dominator tree, by walking
+// up the idom chain. Unreachable blocks are dominated by every block.
+void Dominators::generateDomMap(Function &F, const DomTree &tree) {
+  set<string> all;
+  for (BasicBlock &BB : F) {
+    all.insert(BB.getName().str());
+  }
+
+  for (BasicBlock &BB : F) {
+    if (!tree.isReachable(&BB)) {
+      domMap[BB.getName().str()] = all;
+      continue;
+    }
+    set<string> dominators;
+    for (BasicBlock *dom = &BB; dom; dom = tree.getIdom(dom)) {
+      dominators.insert(dom->getName().str());
+    }
+    domMap[BB.getName().str()] = dominators;
+  }
+}
 
 // Transforms the BitVector representation of Dataflow Analysis framework into a
 // map a BasicBlock names and their set of dominators.
@@ -165,20 +277,18 @@ void Dominators::generateDomMap(map<BasicBlock *, struct bbProps *> dfaResult) {
  * Here gen[BB] is a singleton set containing {BB}.
  */
 void Dominators::Analysis::transferFn(struct bbProps *props) {
-  BitVector tmp = props->bbInput;
-  props->bbInput |= props->genSet;
   props->bbOutput = props->bbInput;
-  props->bbInput = tmp;
+  props->bbOutput |= props->genSet;
 }
 
 // For Dominators pass, the meet operator is Intersection
-BitVector Dominators::Analysis::meetFn(vector<BitVector> inputs) {
+void Dominators::Analysis::meetInto(BitVector &dst,
+                                    ArrayRef<const BitVector *> inputs) {
   size_t _sz = inputs.size();
-  BitVector result = inputs[0];
+  dst = *inputs[0];
   for (int itr = 1; itr < _sz; ++itr) {
-    result &= inputs[itr];
+    dst &= *inputs[itr];
   }
-  return result;
 }
 
 char Dominators::ID = 1;
@@ -5,6 +5,7 @@
 #include "llvm/Pass.h"
 
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Support/raw_ostream.h"
 #include <llvm/Analysis/LoopPass.h>
 
@@ -23,6 +24,9 @@ namespace llvm {
  * into the loop body, if the condition for the loop running atleast once is
  * true.
  *
+ * Loops that the profile shows to be cold, i.e. that never iterate, are not
+ * rotated, since the copies of the header's condition would only make the
+ * code bigger. Each decision is reported as an optimization remark.
  */
 class LandingPadTransform : public LoopPass {
 private:
@@ -32,6 +36,7 @@ private:
                           PHINode *);
   void joinPreheaderAndLatchAtExit(BasicBlock *, BasicBlock *, BasicBlock *, Loop *,
                       LoopInfo &);
+  bool isWorthRotating(Loop *, OptimizationRemarkEmitter &);
 
 public:
   static char ID;
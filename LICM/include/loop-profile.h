@@ -0,0 +1,45 @@
+#ifndef __LOOP_PROFILE_H__
+#define __LOOP_PROFILE_H__
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+
+namespace llvm {
+
+/**
+ * @brief LoopProfile answers how often the blocks of a loop run, relative to
+ * its preheader, from BlockFrequencyInfo. When the function has profile data,
+ * e.g. branch weights added by `opt -pgo-instr-use` from the .profdata file
+ * of an instrumented run, the frequencies are the measured ones. Otherwise,
+ * they are the static estimates of BranchProbabilityInfo, and a loop is never
+ * considered cold.
+ *
+ * Blocks created after BlockFrequencyInfo was computed have no frequency, so
+ * a loop whose preheader is such a block is treated as having no profile.
+ */
+class LoopProfile {
+private:
+  BlockFrequencyInfo &BFI;
+  BasicBlock *header;
+  BasicBlock *latch;
+  uint64_t preHeaderFreq; // Frequency of the preheader, 0 if unknown
+
+public:
+  LoopProfile(Loop *L, BlockFrequencyInfo &BFI);
+
+  // Average number of times the header runs each time the loop is entered,
+  // or 0 if it is unknown.
+  double getHeaderRunsPerEntry();
+
+  // Returns true if the function was profiled, and the loop never went back
+  // to its header, i.e. its body did not run or ran once at most.
+  bool isCold();
+
+  // Returns true if BB runs less often than the preheader, so that an
+  // instruction moved from BB to the preheader would run more often.
+  bool isColderThanPreheader(BasicBlock *BB);
+};
+} // namespace llvm
+
+#endif
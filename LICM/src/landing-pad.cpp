@@ -2,11 +2,23 @@
 // Group: Swati Lodha, Abhijit Tripathy
 
 #include "landing-pad.h"
+#include "loop-profile.h"
+#include "pass-stats.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Support/FormatVariadic.h"
+
 #include <map>
 #include <vector>
 
+#define DEBUG_TYPE "landing-pad"
+
 using namespace std;
 
+STATISTIC(NumLandingPads, "Number of landing pads inserted");
+STATISTIC(NumColdLoops, "Number of loops not rotated, as they are cold");
+
 namespace llvm {
 
 LandingPadTransform::LandingPadTransform() : LoopPass(ID) {}
@@ -211,13 +223,50 @@ void LandingPadTransform::updatePhiUsesOutsideLoop(
   }
 }
 
+/* Rotating a loop copies the non-Phi instructions of its header twice, and
+ * only pays off if the loop iterates, so that hoisting its invariants into the
+ * landing pad saves their repeated execution. Returns false if the profile
+ * shows that the loop never goes back to its header.
+ */
+bool LandingPadTransform::isWorthRotating(Loop *L,
+                                          OptimizationRemarkEmitter &ORE) {
+  LoopProfile profile(
+      L, getAnalysis<BlockFrequencyInfoWrapperPass>().getBFI());
+  BasicBlock *header = L->getHeader();
+
+  if (profile.isCold()) {
+    ORE.emit([&]() {
+      return OptimizationRemarkMissed(DEBUG_TYPE, "ColdLoop", L->getStartLoc(),
+                                      header)
+             << "loop not rotated, as it never iterates in the profile";
+    });
+    return false;
+  }
+  double runs = profile.getHeaderRunsPerEntry();
+  ORE.emit([&]() {
+    return OptimizationRemark(DEBUG_TYPE, "Rotated", L->getStartLoc(), header)
+           << "inserted a landing pad, the header runs "
+           << ore::NV("HeaderRuns", formatv("{0:F1}", runs).str()) << " times per entry";
+  });
+  return true;
+}
+
 bool LandingPadTransform::runOnLoop(Loop *L, LPPassManager &LPM) {
   BasicBlock *preHeader = L->getLoopPreheader();
   BasicBlock *header = L->getHeader();
+  PassStats stats("landing-pad", *header->getParent(), header);
 
   LoopInfo &loopInfo = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
 
   if (preHeader != nullptr) {
+    Function *F = header->getParent();
+    OptimizationRemarkEmitter ORE(F);
+    if (!isWorthRotating(L, ORE)) {
+      ++NumColdLoops;
+      stats.addTransform("cold_loops");
+      return false;
+    }
+
     BasicBlock *landingPad =
         preHeader->splitBasicBlock(preHeader->getTerminator(), ".landingpad");
 
@@ -237,6 +286,8 @@ bool LandingPadTransform::runOnLoop(Loop *L, LPPassManager &LPM) {
 
     joinPreheaderAndLatchAtExit(preHeader, header, loopLatch, L, loopInfo);
 
+    ++NumLandingPads;
+    stats.addTransform("landing_pads");
     return true;
   }
 
@@ -245,6 +296,7 @@ bool LandingPadTransform::runOnLoop(Loop *L, LPPassManager &LPM) {
 
 void LandingPadTransform::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<BlockFrequencyInfoWrapperPass>();
 }
 
 char LandingPadTransform::ID = 2;
@@ -1,25 +1,176 @@
 // ECE/CS 5544 Assignment 3: licm.cpp
 // Group: Swati Lodha, Abhijit Tripathy
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/MemoryLocation.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+#include "dom-tree.h"
+#include "loop-profile.h"
+#include "pass-stats.h"
 
 #include <map>
 #include <set>
 #include <vector>
 
+#define DEBUG_TYPE "loop-invariant-code-motion"
+
 using namespace std;
 
+STATISTIC(NumHoisted, "Number of instructions hoisted out of loops");
+STATISTIC(NumPhisReplaced, "Number of invariant Phis replaced by their value");
+STATISTIC(NumPromoted, "Number of memory locations promoted to registers");
+STATISTIC(NumSunk, "Number of instructions sunk out of loops");
+STATISTIC(NumColdLoops, "Number of loops skipped, as they are cold");
+STATISTIC(NumNotProfitable,
+          "Number of invariants left in loops, as hoisting them would not pay");
+
+static llvm::cl::opt<bool>
+    Sink("licm-sink",
+         llvm::cl::desc("Sink the instructions only used after the loop into "
+                        "its exit blocks"),
+         llvm::cl::init(true));
+
+static llvm::cl::opt<unsigned> RegisterLimit(
+    "licm-register-limit",
+    llvm::cl::desc("Values that can be live across a loop without spilling, "
+                   "0 for the number of registers of the target"),
+    llvm::cl::init(0));
+
 namespace llvm {
 class LICM : public LoopPass {
 private:
   map<string, set<string>> dominators;
-  vector<Value *> loopInvariantInstructions;
+  // Loop-invariant instructions of the current loop, in the order they were
+  // found, which is an order in which each follows its operands. The set is
+  // the same instructions, for constant-time lookups.
+  vector<Instruction *> loopInvariantInstructions;
+  SmallPtrSet<Instruction *, 32> invariant;
+
+  AAResults *AA;
+  TargetLibraryInfo *TLI;
+  // Instructions of the current loop that may write to memory, and whether
+  // any instruction of the loop may throw or not return.
+  vector<Instruction *> loopWriters;
+  bool loopMayThrow;
+  SmallVector<BasicBlock *, 8> loopExiting; // Blocks that leave the loop
+  DomTree domTree;   // Dominator tree of the current loop's function
+  bool domTreeValid; // domTree has been built for the current loop
+
+  OptimizationRemarkEmitter *ORE;
+  // Estimate of the register pressure of the current loop: the values that
+  // are defined outside of it and used in it, with their number of uses in
+  // the loop, and the number of values live across the loop, i.e. those and
+  // the Phis of the header.
+  DenseMap<Value *, unsigned> liveInUses;
+  unsigned pressure;
+  unsigned registerLimit;
+
+  // Kinds of instructions that are considered for hoisting.
+  bool isCandidate(Instruction *I) {
+    return isa<BinaryOperator>(I) || isa<UnaryOperator>(I) || isa<CastInst>(I) ||
+           isa<CmpInst>(I) || isa<GetElementPtrInst>(I) || isa<SelectInst>(I) ||
+           isCandidateCall(I) || isa<PHINode>(I) || isa<LoadInst>(I);
+  }
+
+  /* Calls are only considered if they do not access memory, if they only
+   * read it, so that alias analysis can tell whether the loop writes to what
+   * they read, or if they are intrinsics LLVM knows are safe to speculate.
+   * Any other call may write to memory, and must run once per iteration.
+   */
+  bool isCandidateCall(Instruction *I) {
+    CallInst *call = dyn_cast<CallInst>(I);
+    if (call == NULL || isa<DbgInfoIntrinsic>(call))
+      return false;
+    return call->doesNotAccessMemory() || call->onlyReadsMemory() ||
+           (isa<IntrinsicInst>(call) && isSafeToSpeculativelyExecute(call));
+  }
+
+  /* Returns true if I can run where the loop would not have run it. Beside
+   * the instructions LLVM knows to be safe, calls to library functions that
+   * do not access memory, cannot throw and always return, like sqrt, only
+   * compute their result, and are treated the same.
+   */
+  bool isSpeculatable(Instruction *I) {
+    if (isSafeToSpeculativelyExecute(I))
+      return true;
+    CallInst *call = dyn_cast<CallInst>(I);
+    LibFunc func;
+    return call != NULL && call->getCalledFunction() != NULL &&
+           call->doesNotAccessMemory() && call->doesNotThrow() &&
+           call->willReturn() && TLI->getLibFunc(*call, func);
+  }
+
+  // Returns true if V is a constant, is defined outside of L, or is a
+  // loop-invariant instruction.
+  bool isInvariantValue(Value *V, Loop *L) {
+    Instruction *def = dyn_cast<Instruction>(V);
+    return def == NULL || !L->contains(def) || invariant.count(def);
+  }
+
+  /* A load is invariant if its address is, and no instruction of the loop may
+   * write to the memory it reads, as far as alias analysis can tell. It is
+   * only hoisted if it cannot trap, or if the loop runs it anyway.
+   */
+  bool isInvariantLoad(LoadInst *load, Loop *L) {
+    if (!load->isSimple() || !isInvariantValue(load->getPointerOperand(), L) ||
+        !(isSafeToSpeculativelyExecute(load) ||
+          isGuaranteedToExecute(load->getParent()))) {
+      return false;
+    }
+    MemoryLocation loc = MemoryLocation::get(load);
+    for (Instruction *writer : loopWriters) {
+      if (isModSet(AA->getModRefInfo(writer, loc))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /* A call that only reads memory is invariant like a load: if its operands
+   * are, and no instruction of the loop may write to the memory it reads. It
+   * must also have no side effects, i.e. not throw and always return, and is
+   * only hoisted if the loop runs it anyway.
+   */
+  bool isInvariantCall(CallInst *call, Loop *L) {
+    if (call->mayHaveSideEffects() ||
+        !isGuaranteedToExecute(call->getParent())) {
+      return false;
+    }
+    for (Value *op : call->operands()) {
+      if (!isInvariantValue(op, L)) {
+        return false;
+      }
+    }
+    for (Instruction *writer : loopWriters) {
+      // Only calls and stores have a location to compare the call with.
+      if (!isa<CallBase>(writer) && !isa<StoreInst>(writer)) {
+        return false;
+      }
+      if (isModSet(AA->getModRefInfo(writer, call))) {
+        return false;
+      }
+    }
+    return true;
+  }
 
   /**
    * @brief This function checks if a given Instruction within a loop is
@@ -30,14 +181,36 @@ private:
    * is loop-invariant.
    *
    * @param I
-   * @param loopInstructions
+   * @param L
    * @return true
    * @return false
    */
-  bool isInvariant(Instruction *I, set<Value *> loopInstructions) {
-    // Base condition for loop-invariance.
-    bool preCheck = isSafeToSpeculativelyExecute(I) &&
-                    !I->mayReadFromMemory() && !isa<LandingPadInst>(I);
+  bool isInvariant(Instruction *I, Loop *L) {
+    // A Phi whose incoming values are all the same value, apart from the Phi
+    // itself, is only a copy of it, and is invariant if that value is. Any
+    // other Phi chooses between values depending on the path taken, so it is
+    // not.
+    if (PHINode *phi = dyn_cast<PHINode>(I)) {
+      Value *V = phi->hasConstantValue();
+      return V != NULL && isInvariantValue(V, L);
+    }
+    if (LoadInst *load = dyn_cast<LoadInst>(I)) {
+      return isInvariantLoad(load, L);
+    }
+    CallInst *call = dyn_cast<CallInst>(I);
+    if (call && !call->doesNotAccessMemory() && call->onlyReadsMemory()) {
+      return isInvariantCall(call, L);
+    }
+
+    // Base condition for loop-invariance. An instruction the loop runs anyway
+    // may trap, but must have no other side effect, as it runs once instead
+    // of once per iteration. Of the calls, only the ones that do not access
+    // memory are left at this point.
+    bool preCheck =
+        (isSpeculatable(I) || (isGuaranteedToExecute(I->getParent()) &&
+                               !I->mayHaveSideEffects())) &&
+        !I->mayReadFromMemory() && !isa<LandingPadInst>(I) &&
+        (call == NULL || call->doesNotAccessMemory());
 
     if (!preCheck) {
       return preCheck;
@@ -54,61 +227,593 @@ private:
 
       // Condition 2. If both operands of an instruction are defined outside the
       // loop, then we can this instruction as loop-invariant.
-      if (loopInstructions.find(*op) == loopInstructions.end()) {
+      Instruction *def = dyn_cast<Instruction>(*op);
+      if (def == NULL || !L->contains(def)) {
         continue;
       }
 
       // Condition 3. If an instruction's operands are defined inside the loop,
       // but their definitions are loop-invariant instructions, then the current
       // instruction is also treated as loop-invariant.
-      if (find(loopInvariantInstructions.begin(),
-               loopInvariantInstructions.end(),
-               *op) == loopInvariantInstructions.end()) {
+      if (!invariant.count(def)) {
         return false;
       }
     }
     return true;
   }
 
-  void populateLoopInvariantInstructions(Loop *L,
-                                         set<Value *> loopInstructions) {
-    // We iterate the loop in post-order fashion, so that the loop-invariant
-    // instructions stored in vector are topologically queue.
+  /* Finds the loop-invariant instructions of L with a worklist. Every
+   * candidate is checked once, and afterwards an instruction is only checked
+   * again when one of its operands has just been found invariant, so each
+   * instruction is checked at most once per operand. The blocks of a loop are
+   * not in any particular order, but the worklist reaches the same fixed
+   * point whatever the order, and an instruction is always found after the
+   * in-loop operands that make it invariant.
+   */
+  void populateLoopInvariantInstructions(Loop *L) {
+    loopInvariantInstructions.clear();
+    invariant.clear();
+    loopWriters.clear();
+    loopMayThrow = false;
+    loopExiting.clear();
+    L->getExitingBlocks(loopExiting);
+    domTreeValid = false;
+
+    SmallVector<Instruction *, 64> worklist;
     for (Loop::block_iterator bitr = L->block_begin(); bitr != L->block_end();
          ++bitr) {
       BasicBlock *BB = *bitr;
       for (BasicBlock::iterator itr = BB->begin(); itr != BB->end(); ++itr) {
-        Instruction *I = &*itr;
-        if (isa<BinaryOperator>(I) || isa<PHINode>(I)) {
-          // Check for invariance.
-          if (isInvariant(I, loopInstructions)) {
-            loopInvariantInstructions.push_back(I);
+        if (itr->mayWriteToMemory())
+          loopWriters.push_back(&*itr);
+        loopMayThrow |= !isGuaranteedToTransferExecutionToSuccessor(&*itr);
+        if (isCandidate(&*itr))
+          worklist.push_back(&*itr);
+      }
+    }
+    // Pop the instructions in block order.
+    std::reverse(worklist.begin(), worklist.end());
+
+    while (!worklist.empty()) {
+      Instruction *I = worklist.pop_back_val();
+      // Check for invariance.
+      if (invariant.count(I) || !isInvariant(I, L))
+        continue;
+      invariant.insert(I);
+      loopInvariantInstructions.push_back(I);
+
+      // Only the users of I can become invariant because of it.
+      for (User *U : I->users()) {
+        Instruction *user = dyn_cast<Instruction>(U);
+        if (user && isCandidate(user) && L->contains(user) &&
+            !invariant.count(user))
+          worklist.push_back(user);
+      }
+    }
+  }
+
+  /* Estimates the register pressure of L as the number of values live across
+   * it: the values defined outside of the loop and used in it, which must be
+   * kept in registers for the whole loop, and the values carried from one
+   * iteration to the next by the Phis of the header. The values that only
+   * live within an iteration are not counted.
+   */
+  void estimateRegisterPressure(Loop *L) {
+    liveInUses.clear();
+    pressure = 0;
+    for (Loop::block_iterator bitr = L->block_begin(); bitr != L->block_end();
+         ++bitr) {
+      for (Instruction &I : **bitr) {
+        if (isa<PHINode>(I) && I.getParent() == L->getHeader())
+          ++pressure;
+        for (Value *op : I.operands()) {
+          if ((isa<Instruction>(op) && !L->contains(cast<Instruction>(op))) ||
+              isa<Argument>(op))
+            ++liveInUses[op];
+        }
+      }
+    }
+    pressure += liveInUses.size();
+  }
+
+  /* Returns how the number of values live across L changes if I is hoisted:
+   * I is live across the loop if it is still used in it, and the operands of
+   * I that were only used by I in the loop are not anymore.
+   */
+  int getPressureDelta(Instruction *I, Loop *L) {
+    int delta = 0;
+    for (User *U : I->users()) {
+      if (L->contains(cast<Instruction>(U))) {
+        delta = 1;
+        break;
+      }
+    }
+    SmallDenseMap<Value *, unsigned, 4> uses;
+    for (Value *op : I->operands()) {
+      if (liveInUses.count(op))
+        ++uses[op];
+    }
+    for (auto &use : uses) {
+      if (liveInUses[use.first] == use.second)
+        --delta;
+    }
+    return delta;
+  }
+
+  // Updates the live values of L, after I has been hoisted.
+  void hoistedFromLoop(Instruction *I, Loop *L) {
+    for (Value *op : I->operands()) {
+      auto itr = liveInUses.find(op);
+      if (itr != liveInUses.end() && --itr->second == 0)
+        liveInUses.erase(itr);
+    }
+    for (User *U : I->users()) {
+      if (L->contains(cast<Instruction>(U)))
+        ++liveInUses[I];
+    }
+  }
+
+  /* Returns true if hoisting I out of L pays off: I must not run more often
+   * in the preheader than it does in the loop, as it would if its block is
+   * colder than the preheader, and it must not make more values live across
+   * the loop than there are registers, unless it makes fewer.
+   */
+  bool isWorthHoisting(Instruction *I, LoopProfile &profile, int delta) {
+    if (profile.isColderThanPreheader(I->getParent())) {
+      ORE->emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotProfitable", I)
+               << "not hoisting " << ore::NV("Inst", I)
+               << ", as it would run more often in the preheader";
+      });
+      return false;
+    }
+    if (delta > 0 && pressure + delta > registerLimit) {
+      ORE->emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "RegisterPressure", I)
+               << "not hoisting " << ore::NV("Inst", I) << ", as "
+               << ore::NV("LiveValues", pressure)
+               << " values are live across the loop already";
+      });
+      return false;
+    }
+    return true;
+  }
+
+  /* Hoists the loop-invariant instructions to the end of the preheader, in
+   * the order they were found, so that every instruction is placed after the
+   * operands it was found invariant with, and whole expression trees leave
+   * the loop in one run. A Phi cannot be moved out of its block, so the Phis
+   * that are copies of an invariant value are replaced by that value instead.
+   * They are replaced in the same order, before any of their users is moved.
+   *
+   * The instructions that are not worth hoisting stay in the loop, and so do
+   * the ones that depend on them. They are no longer invariant, as far as the
+   * loads and stores promoted afterwards are concerned. Returns true if any
+   * instruction was hoisted or replaced.
+   */
+  bool hoistInvariants(Loop *L, BasicBlock *preHeader, LoopProfile &profile,
+                       PassStats &stats) {
+    bool changed = false;
+    SmallVector<PHINode *, 4> replaced;
+    for (Instruction *inv : loopInvariantInstructions) {
+      if (PHINode *phi = dyn_cast<PHINode>(inv)) {
+        Value *V = phi->hasConstantValue();
+        Instruction *def = dyn_cast<Instruction>(V);
+        if (def && L->contains(def)) {
+          invariant.erase(inv);
+          continue;
+        }
+        phi->replaceAllUsesWith(V);
+        replaced.push_back(phi);
+        ++NumPhisReplaced;
+        stats.addTransform("phis_replaced");
+        continue;
+      }
+
+      bool operandsHoisted = true;
+      for (Value *op : inv->operands()) {
+        Instruction *def = dyn_cast<Instruction>(op);
+        if (def && L->contains(def))
+          operandsHoisted = false;
+      }
+      int delta = getPressureDelta(inv, L);
+      if (!operandsHoisted || !isWorthHoisting(inv, profile, delta)) {
+        invariant.erase(inv);
+        ++NumNotProfitable;
+        stats.addTransform("not_profitable");
+        continue;
+      }
+      inv->moveBefore(preHeader->getTerminator());
+      changed = true;
+      pressure += delta;
+      hoistedFromLoop(inv, L);
+      ORE->emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "Hoisted", inv)
+               << "hoisted " << ore::NV("Inst", inv) << " out of the loop";
+      });
+      ++NumHoisted;
+      stats.addTransform("hoisted");
+    }
+
+    // The replaced Phis are only deleted once the loop over the invariants is
+    // done, and nothing refers to them anymore.
+    for (PHINode *phi : replaced) {
+      invariant.erase(phi);
+      erase_value(loopInvariantInstructions, phi);
+      phi->eraseFromParent();
+    }
+    return changed || !replaced.empty();
+  }
+
+  /* Splits the exit blocks of L that are also reached from outside of it, so
+   * that every exit block is only reached from L. The in-loop predecessors
+   * are redirected to a new block, which gets Phis for the values they bring
+   * to the Phis of the exit block.
+   *
+   * An EH pad can only be reached by the unwind edges of invokes, and the
+   * successors of an indirectbr or a callbr cannot be replaced by a new
+   * block, so if such an exit would have to be split, nothing is done and
+   * false is returned.
+   */
+  bool formDedicatedExits(Loop *L) {
+    LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    SmallVector<BasicBlock *, 8> exits;
+    L->getUniqueExitBlocks(exits);
+
+    for (BasicBlock *exit : exits) {
+      if (all_of(predecessors(exit),
+                 [&](BasicBlock *pred) { return L->contains(pred); }))
+        continue;
+      if (exit->isEHPad())
+        return false;
+      for (BasicBlock *pred : predecessors(exit)) {
+        Instruction *term = pred->getTerminator();
+        if (L->contains(pred) &&
+            (isa<IndirectBrInst>(term) || isa<CallBrInst>(term)))
+          return false;
+      }
+    }
+
+    for (BasicBlock *exit : exits) {
+      SmallSetVector<BasicBlock *, 4> inLoopPreds;
+      bool outsidePred = false;
+      for (BasicBlock *pred : predecessors(exit)) {
+        if (L->contains(pred))
+          inLoopPreds.insert(pred);
+        else
+          outsidePred = true;
+      }
+      if (!outsidePred)
+        continue;
+
+      BasicBlock *dedicated =
+          BasicBlock::Create(exit->getContext(), exit->getName() + ".loopexit",
+                             exit->getParent(), exit);
+      BranchInst *br = BranchInst::Create(exit, dedicated);
+      for (PHINode &phi : exit->phis()) {
+        PHINode *inner = PHINode::Create(phi.getType(), inLoopPreds.size(),
+                                         phi.getName() + ".loopexit", br);
+        for (int k = phi.getNumIncomingValues() - 1; k >= 0; --k) {
+          if (!L->contains(phi.getIncomingBlock(k)))
+            continue;
+          inner->addIncoming(phi.getIncomingValue(k), phi.getIncomingBlock(k));
+          phi.removeIncomingValue(k, false);
+        }
+        phi.addIncoming(inner, dedicated);
+      }
+      for (BasicBlock *pred : inLoopPreds) {
+        pred->getTerminator()->replaceSuccessorWith(exit, dedicated);
+      }
+
+      // The new block belongs to the innermost loop that contains the exit.
+      Loop *parent = L->getParentLoop();
+      while (parent != NULL && !parent->contains(exit))
+        parent = parent->getParentLoop();
+      if (parent != NULL)
+        parent->addBasicBlockToLoop(dedicated, LI);
+    }
+    return true;
+  }
+
+  /* Returns true if BB runs whenever the current loop is entered, so that the
+   * instructions in it that may trap can be hoisted: BB dominates every block
+   * that leaves the loop, and nothing in the loop may throw or not return, so
+   * it cannot be left any other way. A loop that is never left may never get
+   * to BB. Once the landing-pad pass has rotated a loop, its body is on every
+   * path to the latch exit, so the whole body is guaranteed to run. The
+   * dominator tree is only built for the loops that need it.
+   */
+  bool isGuaranteedToExecute(BasicBlock *BB) {
+    return !loopMayThrow && dominatesExiting(BB);
+  }
+
+  // Returns true if BB dominates every block that leaves the current loop.
+  bool dominatesExiting(BasicBlock *BB) {
+    if (loopExiting.empty())
+      return false;
+    if (!domTreeValid) {
+      domTree.recalculate(*BB->getParent());
+      domTreeValid = true;
+    }
+    for (BasicBlock *exiting : loopExiting) {
+      if (!domTree.dominates(BB, exiting))
+        return false;
+    }
+    return true;
+  }
+
+  /* Promotes the memory locations that L only accesses at a loop-invariant
+   * address to registers: the location is loaded once in the preheader, its
+   * value is kept in SSA form inside the loop, and it is stored back in every
+   * exit block. A location is promoted if:
+   *   - every access of the loop that may alias it is a simple load or store
+   *     of the same type, through the same pointer,
+   *   - one of those stores runs on every path that leaves the loop, so the
+   *     location is written anyway, and the preheader load cannot trap where
+   *     the store would not,
+   *   - nothing in the loop may throw, so that the loop cannot be left
+   *     without going through an exit block.
+   * Exit blocks that are also reached from outside of the loop, like the ones
+   * LandingPadTransform joins the loop guard to, are split first, so that the
+   * stores only run when leaving the loop. Returns true if the loop was
+   * changed, even if only its exits were split.
+   */
+  bool promoteMemoryToRegisters(Loop *L, BasicBlock *preHeader,
+                                PassStats &stats) {
+    if (loopMayThrow || loopExiting.empty())
+      return false;
+
+    // The addresses stored to, and the type of the first store to each.
+    MapVector<Value *, Type *> locations;
+    for (Instruction *writer : loopWriters) {
+      StoreInst *store = dyn_cast<StoreInst>(writer);
+      if (store && store->isSimple() &&
+          isInvariantValue(store->getPointerOperand(), L))
+        locations.insert({store->getPointerOperand(),
+                          store->getValueOperand()->getType()});
+    }
+    if (locations.empty())
+      return false;
+
+    bool changed = false;
+    if (!L->hasDedicatedExits()) {
+      if (!formDedicatedExits(L))
+        return false;
+      domTreeValid = false;
+      changed = true;
+    }
+    SmallVector<BasicBlock *, 8> exits;
+    L->getUniqueExitBlocks(exits);
+
+    Function *F = preHeader->getParent();
+    const DataLayout &DL = F->getParent()->getDataLayout();
+
+    for (auto &location : locations) {
+      Value *ptr = location.first;
+      Type *type = location.second;
+      MemoryLocation loc(ptr, LocationSize::precise(DL.getTypeStoreSize(type)));
+
+      SmallVector<Instruction *, 8> accesses;
+      bool promotable = true, guaranteed = false;
+      Align alignment(1);
+      for (Loop::block_iterator bitr = L->block_begin();
+           bitr != L->block_end() && promotable; ++bitr) {
+        for (Instruction &I : **bitr) {
+          if (!I.mayReadOrWriteMemory())
+            continue;
+          LoadInst *load = dyn_cast<LoadInst>(&I);
+          StoreInst *store = dyn_cast<StoreInst>(&I);
+          if (load && load->isSimple() && load->getPointerOperand() == ptr &&
+              load->getType() == type) {
+            alignment = std::max(alignment, load->getAlign());
+          } else if (store && store->isSimple() &&
+                     store->getPointerOperand() == ptr &&
+                     store->getValueOperand()->getType() == type) {
+            alignment = std::max(alignment, store->getAlign());
+            guaranteed |= isGuaranteedToExecute(*bitr);
+          } else {
+            if (isModOrRefSet(AA->getModRefInfo(&I, loc))) {
+              promotable = false;
+              break;
+            }
+            continue;
           }
+          accesses.push_back(&I);
         }
       }
+      if (!promotable || !guaranteed)
+        continue;
+
+      // The value of the location is carried from one iteration to the next,
+      // and the address is not used in the loop anymore, unless by others.
+      int delta = liveInUses.lookup(ptr) == accesses.size() ? 0 : 1;
+      if (delta > 0 && pressure + delta > registerLimit) {
+        ORE->emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "RegisterPressure",
+                                          accesses[0])
+                 << "not promoting " << ore::NV("Location", ptr) << ", as "
+                 << ore::NV("LiveValues", pressure)
+                 << " values are live across the loop already";
+        });
+        continue;
+      }
+      pressure += delta;
+      liveInUses.erase(ptr);
+
+      SSAUpdater SSA;
+      LoopPromoter promoter(accesses, SSA, ptr, exits, alignment);
+      LoadInst *initial =
+          new LoadInst(type, ptr, ptr->getName() + ".promoted", false,
+                       alignment, preHeader->getTerminator());
+      SSA.AddAvailableValue(preHeader, initial);
+      promoter.run(accesses);
+      changed = true;
+      ORE->emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "Promoted", initial)
+               << "promoted " << ore::NV("Location", ptr)
+               << " to a register in the loop";
+      });
+      ++NumPromoted;
+      stats.addTransform("promoted");
     }
+    return changed;
   }
 
-  set<Value *> getLoopInstructions(Loop *L) {
-    set<Value *> loopInstructions; // Set of Loop Instructions
+  /* Returns true if I can be sunk out of L: it has no side effects and does
+   * not read memory, its block runs on the last iteration of every run of the
+   * loop, and all of its users are outside of the loop. Then the value it
+   * leaves the loop with is the one computed from the values its operands
+   * leave the loop with, so it can be computed in the exit blocks instead.
+   * The Phis of the exit blocks that only carry I out of the loop, like the
+   * ones LandingPadTransform creates, are replaced along with it, but a Phi
+   * that merges I with other values keeps I in the loop.
+   */
+  bool isSinkable(Instruction *I, Loop *L, LoopInfo &LI) {
+    if (!isCandidate(I) || isa<PHINode>(I) || I->mayReadFromMemory() ||
+        I->use_empty() || !isSpeculatable(I) ||
+        LI.getLoopFor(I->getParent()) != L)
+      return false;
+    for (User *U : I->users()) {
+      Instruction *user = cast<Instruction>(U);
+      if (L->contains(user))
+        return false;
+      PHINode *phi = dyn_cast<PHINode>(user);
+      if (phi && isExitPhi(phi, L) && phi->hasConstantValue() != I)
+        return false;
+    }
+    return dominatesExiting(I->getParent());
+  }
+
+  // Returns true if phi is in an exit block of L, and merges values leaving
+  // the loop.
+  bool isExitPhi(PHINode *phi, Loop *L) {
+    for (BasicBlock *pred : phi->blocks()) {
+      if (L->contains(pred))
+        return true;
+    }
+    return false;
+  }
 
+  /* Moves the instructions of L that are only used after the loop into its
+   * exit blocks, so that they are computed once rather than on every
+   * iteration. A copy of the instruction is put at the top of every exit
+   * block, and each use is rewritten to the copy of the exit it is reached
+   * from, with new Phis where the paths from several exits join, by
+   * SSAUpdater. The copies that end up unused are deleted. The instructions
+   * are visited from the bottom of the loop up, and sinking an instruction
+   * can let its operands be sunk after it, so whole expression trees leave
+   * the loop; the copies of the operands go before the copies of their users.
+   * Nothing is sunk if the exits cannot all be made dedicated. Returns true
+   * if the loop was changed, even if only its exits were split.
+   */
+  bool sinkInstructions(Loop *L, PassStats &stats) {
+    LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    SmallSetVector<Instruction *, 64> worklist;
     for (Loop::block_iterator bitr = L->block_begin(); bitr != L->block_end();
          ++bitr) {
-      BasicBlock *BB = *bitr;
+      for (Instruction &I : **bitr) {
+        worklist.insert(&I);
+      }
+    }
 
-      // Create a set of instructions contained within the loop. This set will
-      // help identify if the operands of an instruction is defined inside the
-      // loop.
-      for (BasicBlock::iterator itr = BB->begin(); itr != BB->end(); ++itr) {
-        if (isa<BinaryOperator>(*itr) || isa<PHINode>(*itr)) {
-          Value *V = &*itr;
-          loopInstructions.insert(V);
+    bool changed = false;
+    SmallVector<BasicBlock *, 8> exits;
+    while (!worklist.empty()) {
+      Instruction *I = worklist.pop_back_val();
+      if (!isSinkable(I, L, LI))
+        continue;
+
+      if (exits.empty()) {
+        if (!L->hasDedicatedExits()) {
+          if (!formDedicatedExits(L))
+            return changed;
+          domTreeValid = false;
+          changed = true;
+          if (!isSinkable(I, L, LI))
+            continue;
         }
+        L->getUniqueExitBlocks(exits);
+      }
+
+      SSAUpdater SSA;
+      SSA.Initialize(I->getType(), I->getName());
+      map<BasicBlock *, Instruction *> copies;
+      for (BasicBlock *exit : exits) {
+        Instruction *copy = I->clone();
+        copy->setName(I->getName() + ".sunk");
+        copy->insertBefore(&*exit->getFirstInsertionPt());
+        copies[exit] = copy;
+        SSA.AddAvailableValue(exit, copy);
+      }
+
+      // The users are rewritten one at a time, as rewriting a Phi of an exit
+      // block deletes it.
+      SmallVector<Instruction *, 8> users;
+      for (User *U : I->users()) {
+        Instruction *user = cast<Instruction>(U);
+        if (find(users, user) == users.end())
+          users.push_back(user);
+      }
+      for (Instruction *user : users) {
+        PHINode *phi = dyn_cast<PHINode>(user);
+        if (phi && isExitPhi(phi, L)) {
+          phi->replaceAllUsesWith(copies[phi->getParent()]);
+          phi->eraseFromParent();
+        } else if (!phi && copies.count(user->getParent())) {
+          user->replaceUsesOfWith(I, copies[user->getParent()]);
+        } else {
+          for (Use &use : make_early_inc_range(user->operands())) {
+            if (use.get() == I)
+              SSA.RewriteUse(use);
+          }
+        }
+      }
+      for (auto &copy : copies) {
+        if (copy.second->use_empty())
+          copy.second->eraseFromParent();
+      }
+
+      for (Value *op : I->operands()) {
+        Instruction *def = dyn_cast<Instruction>(op);
+        if (def && L->contains(def))
+          worklist.insert(def);
       }
+      ORE->emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "Sunk", I)
+               << "sunk " << ore::NV("Inst", I) << " into the loop exits";
+      });
+      I->eraseFromParent();
+      changed = true;
+      ++NumSunk;
+      stats.addTransform("sunk");
     }
-    return loopInstructions;
+    return changed;
   }
 
+  /* Rewrites the promoted loads and stores of a location in SSA form, and
+   * stores the value the location holds when the loop is left in each of its
+   * exit blocks.
+   */
+  class LoopPromoter : public LoadAndStorePromoter {
+  private:
+    Value *ptr;
+    ArrayRef<BasicBlock *> exits;
+    Align alignment;
+
+  public:
+    LoopPromoter(ArrayRef<const Instruction *> accesses, SSAUpdater &SSA,
+                 Value *ptr, ArrayRef<BasicBlock *> exits, Align alignment)
+        : LoadAndStorePromoter(accesses, SSA), ptr(ptr), exits(exits),
+          alignment(alignment) {}
+
+    void doExtraRewritesBeforeFinalDeletion() override {
+      for (BasicBlock *exit : exits) {
+        Value *live = SSA.GetValueInMiddleOfBlock(exit);
+        new StoreInst(live, ptr, false, alignment, &*exit->getFirstInsertionPt());
+      }
+    }
+  };
+
 public:
   static char ID;
 
@@ -121,9 +826,15 @@ public:
 
   void getAnalysisUsage(AnalysisUsage &AU) const {
     AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<AAResultsWrapperPass>();
+    AU.addRequired<TargetLibraryInfoWrapperPass>();
+    AU.addRequired<TargetTransformInfoWrapperPass>();
+    AU.addRequired<BlockFrequencyInfoWrapperPass>();
   }
 
   bool runOnLoop(Loop *L, LPPassManager &LPM) override {
+    PassStats stats("loop-invariant-code-motion", *L->getHeader()->getParent(),
+                    L->getHeader());
 
     BasicBlock *preHeader = L->getLoopPreheader();
 
@@ -132,17 +843,43 @@ public:
       outs() << "No loop preheader found. Skipping.\n";
       return false;
     }
-    set<Value *> loopInstructions =
-        getLoopInstructions(L); // Set of Loop Instructions
+    Function *F = preHeader->getParent();
+    OptimizationRemarkEmitter remarks(F);
+    ORE = &remarks;
 
-    populateLoopInvariantInstructions(L, loopInstructions);
+    // Hoisting out of a loop that does not iterate saves nothing.
+    LoopProfile profile(L,
+                        getAnalysis<BlockFrequencyInfoWrapperPass>().getBFI());
+    if (profile.isCold()) {
+      ORE->emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "ColdLoop",
+                                        L->getStartLoc(), L->getHeader())
+               << "loop skipped, as it never iterates in the profile";
+      });
+      ++NumColdLoops;
+      stats.addTransform("cold_loops");
+      return false;
+    }
 
-    for (Value *val : loopInvariantInstructions) {
-      Instruction *inv = dyn_cast<Instruction>(val);
-      inv->moveBefore(preHeader->getTerminator());
+    AA = &getAnalysis<AAResultsWrapperPass>().getAAResults();
+    TLI = &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI(*F);
+    registerLimit = RegisterLimit;
+    if (registerLimit == 0) {
+      const TargetTransformInfo &TTI =
+          getAnalysis<TargetTransformInfoWrapperPass>().getTTI(*F);
+      registerLimit =
+          TTI.getNumberOfRegisters(TTI.getRegisterClassForType(false));
     }
 
-    return true;
+    populateLoopInvariantInstructions(L);
+    estimateRegisterPressure(L);
+    bool changed = hoistInvariants(L, preHeader, profile, stats);
+    // The hoisted addresses are now defined outside of the loop.
+    changed |= promoteMemoryToRegisters(L, preHeader, stats);
+    if (Sink)
+      changed |= sinkInstructions(L, stats);
+
+    return changed;
   }
 };
 char LICM::ID = 3;
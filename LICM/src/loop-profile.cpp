@@ -0,0 +1,32 @@
+// ECE/CS 5544 Assignment 3: loop-profile.cpp
+// Group: Swati Lodha, Abhijit Tripathy
+
+#include "loop-profile.h"
+
+namespace llvm {
+
+LoopProfile::LoopProfile(Loop *L, BlockFrequencyInfo &BFI)
+    : BFI(BFI), header(L->getHeader()), latch(L->getLoopLatch()),
+      preHeaderFreq(0) {
+  if (BasicBlock *preHeader = L->getLoopPreheader())
+    preHeaderFreq = BFI.getBlockFreq(preHeader).getFrequency();
+}
+
+double LoopProfile::getHeaderRunsPerEntry() {
+  if (preHeaderFreq == 0)
+    return 0;
+  return (double)BFI.getBlockFreq(header).getFrequency() / preHeaderFreq;
+}
+
+bool LoopProfile::isCold() {
+  if (latch == NULL || !header->getParent()->hasProfileData())
+    return false;
+  Optional<uint64_t> count = BFI.getBlockProfileCount(latch);
+  return count.hasValue() && *count == 0;
+}
+
+bool LoopProfile::isColderThanPreheader(BasicBlock *BB) {
+  return preHeaderFreq != 0 &&
+         BFI.getBlockFreq(BB).getFrequency() < preHeaderFreq;
+}
+} // namespace llvm
@@ -0,0 +1,46 @@
+; The loop can be left through the unwind edge of an invoke, to %lpad, which
+; is also reached from outside of the loop. An EH pad can only be reached by
+; an unwind edge, so that exit cannot be split, and %t, only used after the
+; loop, stays in it.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: body:
+; CHECK-NEXT: %i = phi
+; CHECK-NEXT: %t = mul i32 %i, %a
+; CHECK: lpad:
+; CHECK-NEXT: landingpad
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+declare i32 @__gxx_personality_v0(...)
+
+define void @nop() {
+  ret void
+}
+
+define i32 @f(i32 %n, i32 %a) personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  invoke void @nop() to label %preheader unwind label %lpad
+preheader:
+  br label %body
+body:
+  %i = phi i32 [ 0, %preheader ], [ %i1, %latch ]
+  %t = mul i32 %i, %a
+  invoke void @nop() to label %latch unwind label %lpad
+latch:
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %body, label %exit
+exit:
+  ret i32 %t
+lpad:
+  %lp = landingpad { i8*, i32 } cleanup
+  ret i32 -1
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 5, i32 6)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  ret i32 0
+}
@@ -0,0 +1,50 @@
+; %q may trap, but its block runs on every iteration of the loop, once it has
+; been entered, so it is hoisted. %m only runs on some iterations, and stays.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: preheader:
+; CHECK-NEXT: %q = sdiv i32 %a, %b
+; CHECK: odd:
+; CHECK-NEXT: %m = srem i32 %a, %b
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define i32 @f(i32 %n, i32 %a, i32 %b) {
+entry:
+  %guard = icmp sgt i32 %n, 0
+  br i1 %guard, label %preheader, label %done
+preheader:
+  br label %body
+body:
+  %i = phi i32 [ 0, %preheader ], [ %i1, %latch ]
+  %s = phi i32 [ 0, %preheader ], [ %s2, %latch ]
+  %q = sdiv i32 %a, %b
+  %s1 = add i32 %s, %q
+  %bit = and i32 %i, 1
+  %isodd = icmp ne i32 %bit, 0
+  br i1 %isodd, label %odd, label %latch
+odd:
+  %m = srem i32 %a, %b
+  %sm = add i32 %s1, %m
+  br label %latch
+latch:
+  %s2 = phi i32 [ %s1, %body ], [ %sm, %odd ]
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %body, label %exit
+exit:
+  br label %done
+done:
+  %r = phi i32 [ %s2, %exit ], [ 0, %entry ]
+  ret i32 %r
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 5, i32 17, i32 5)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  %r2 = call i32 @f(i32 0, i32 17, i32 0)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r2)
+  ret i32 0
+}
@@ -0,0 +1,46 @@
+; @count is only accessed at an invariant address in the loop, and the store
+; runs on every iteration, so it is promoted to a register: loaded once in the
+; preheader, and stored back once in the exit block.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: preheader:
+; CHECK-NEXT: %count.promoted = load i32, i32* @count
+; CHECK: body:
+; CHECK-NOT: load
+; CHECK-NOT: store
+; CHECK: exit:
+; CHECK-NEXT: store i32 %new, i32* @count
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+@count = global i32 10
+declare i32 @printf(i8*, ...)
+
+define i32 @f(i32 %n) {
+entry:
+  %guard = icmp sgt i32 %n, 0
+  br i1 %guard, label %preheader, label %done
+preheader:
+  br label %body
+body:
+  %i = phi i32 [ 0, %preheader ], [ %i1, %body ]
+  %old = load i32, i32* @count
+  %new = add i32 %old, %i
+  store i32 %new, i32* @count
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %body, label %exit
+exit:
+  br label %done
+done:
+  %r = load i32, i32* @count
+  ret i32 %r
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 5)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  %r2 = call i32 @f(i32 0)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r2)
+  ret i32 0
+}
@@ -0,0 +1,73 @@
+; @get only reads the memory its argument points to, @g. The loop of @f
+; writes to @h alone, so the call is hoisted, but the loop of @k writes to
+; @g, so the call stays in it.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: preheader:
+; CHECK-NEXT: %v = call i32 @get(i32* @g)
+; CHECK-LABEL: define i32 @k(
+; CHECK: body:
+; CHECK: %v = call i32 @get(i32* @g)
+
+@g = global i32 3
+@h = global i32 0
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define i32 @get(i32* %p) argmemonly readonly nounwind willreturn {
+  %v = load i32, i32* %p
+  ret i32 %v
+}
+
+define i32 @f(i32 %n) {
+entry:
+  %guard = icmp sgt i32 %n, 0
+  br i1 %guard, label %preheader, label %done
+preheader:
+  br label %body
+body:
+  %i = phi i32 [ 0, %preheader ], [ %i1, %body ]
+  %s = phi i32 [ 0, %preheader ], [ %s1, %body ]
+  %v = call i32 @get(i32* @g)
+  %s1 = add i32 %s, %v
+  store i32 %s1, i32* @h
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %body, label %exit
+exit:
+  br label %done
+done:
+  %r = phi i32 [ %s1, %exit ], [ 0, %entry ]
+  ret i32 %r
+}
+
+define i32 @k(i32 %n) {
+entry:
+  %guard = icmp sgt i32 %n, 0
+  br i1 %guard, label %preheader, label %done
+preheader:
+  br label %body
+body:
+  %i = phi i32 [ 0, %preheader ], [ %i1, %body ]
+  %s = phi i32 [ 0, %preheader ], [ %s1, %body ]
+  %v = call i32 @get(i32* @g)
+  %s1 = add i32 %s, %v
+  store i32 %i, i32* @g
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %body, label %exit
+exit:
+  br label %done
+done:
+  %r = phi i32 [ %s1, %exit ], [ 0, %entry ]
+  ret i32 %r
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 5)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  %r2 = call i32 @k(i32 5)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r2)
+  ret i32 0
+}
@@ -0,0 +1,43 @@
+; %t and %u are computed on every iteration, but only used after the loop, so
+; they are sunk into the exit block and computed once.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: body:
+; CHECK-NOT: mul
+; CHECK: exit:
+; CHECK-NEXT: %t.sunk = mul i32 %i, %a
+; CHECK-NEXT: %u.sunk = add i32 %t.sunk, 7
+; CHECK: phi i32 [ %u.sunk, %exit ], [ 0, %entry ]
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define i32 @f(i32 %n, i32 %a) {
+entry:
+  %guard = icmp sgt i32 %n, 0
+  br i1 %guard, label %preheader, label %done
+preheader:
+  br label %body
+body:
+  %i = phi i32 [ 0, %preheader ], [ %i1, %body ]
+  %t = mul i32 %i, %a
+  %u = add i32 %t, 7
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %body, label %exit
+exit:
+  %last = phi i32 [ %u, %body ]
+  br label %done
+done:
+  %r = phi i32 [ %last, %exit ], [ 0, %entry ]
+  ret i32 %r
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 5, i32 3)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  %r2 = call i32 @f(i32 0, i32 3)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r2)
+  ret i32 0
+}
@@ -0,0 +1,48 @@
+; @set writes to @g on every iteration, which the loop reads and resets, so
+; the call must stay in the loop, even though its operands are invariant and
+; its block runs on every iteration.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: body:
+; CHECK: call void @set(i32* @g, i32 %a)
+
+@g = global i32 0
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define void @set(i32* %p, i32 %v) argmemonly writeonly nounwind willreturn {
+  store i32 %v, i32* %p
+  ret void
+}
+
+define i32 @f(i32 %n, i32 %a) {
+entry:
+  %guard = icmp sgt i32 %n, 0
+  br i1 %guard, label %preheader, label %done
+preheader:
+  br label %body
+body:
+  %i = phi i32 [ 0, %preheader ], [ %i1, %body ]
+  %s = phi i32 [ 0, %preheader ], [ %s1, %body ]
+  call void @set(i32* @g, i32 %a)
+  %v = load i32, i32* @g
+  %s1 = add i32 %s, %v
+  store i32 0, i32* @g
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %body, label %exit
+exit:
+  br label %done
+done:
+  %r = phi i32 [ %s1, %exit ], [ 0, %entry ]
+  ret i32 %r
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 4, i32 9)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  %g = load i32, i32* @g
+  call i32 (i8*, ...) @printf(i8* %p, i32 %g)
+  ret i32 0
+}
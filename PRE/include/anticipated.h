@@ -1,22 +1,22 @@
 #ifndef __ANTICIPATED_H___
 #define __ANTICIPATED_H___
 
-#include "dataflow.h"
+#include "static-dataflow.h"
 
 using namespace std;
 using namespace llvm;
 
 namespace llvm {
-class AnticipatedExpressions : public Dataflow {
+/* Anticipated Expressions: a Backward pass, with Intersection as the meet
+ * operator, and F(X) = (X - Kill) U Use as the transfer function.
+ */
+class AnticipatedExpressions
+    : public StaticDataflow<BACKWARD, IntersectMeet, GenKillTransfer> {
   public:
     AnticipatedExpressions(int domainSize, BitVector boundaryCond,
-                           BitVector initCond,
-                           enum passDirection dir = BACKWARD)
-        : Dataflow(domainSize, dir, boundaryCond, initCond) {}
-
-    virtual void transferFn(struct bbProps *props);
-    virtual BitVector meetFn(vector<BitVector> inputs);
+                           BitVector initCond)
+        : StaticDataflow(domainSize, boundaryCond, initCond) {}
   };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,26 +1,38 @@
 #ifndef __WILLBEAVAILABLE_H___
 #define __WILLBEAVAILABLE_H___
 
-#include "dataflow.h"
+#include "static-dataflow.h"
 
 namespace llvm {
 
-class WillBeAvailableExpressions : public Dataflow {
-private:
+// F(X) = (X U Anticipated.in) - Kill
+struct WillBeAvailableTransfer {
   map<BasicBlock *, struct bbProps *> anticipated;
+  vector<const BitVector *> anticipatedIn; // Anticipated.in, by block number
 
+  static const enum transferShape shape = OR_ANDNOT;
+
+  void prepare(ArrayRef<BasicBlock *> blocks);
+
+  const BitVector &operandA(int idx, const BitVector & /* gen */,
+                            const BitVector & /* kill */) {
+    return *anticipatedIn[idx];
+  }
+  const BitVector &operandB(int /* idx */, const BitVector & /* gen */,
+                            const BitVector &kill) {
+    return kill;
+  }
+};
+
+class WillBeAvailableExpressions
+    : public StaticDataflow<FORWARD, IntersectMeet, WillBeAvailableTransfer> {
 public:
   WillBeAvailableExpressions(int domainSize, BitVector boundaryCond,
                              BitVector initCond,
-                             map<BasicBlock *, struct bbProps *> anticipated,
-                             enum passDirection dir = FORWARD)
-      : Dataflow(domainSize, dir, boundaryCond, initCond) {
-    this->anticipated = anticipated;
-  }
-
-  virtual void transferFn(struct bbProps *props);
-  virtual BitVector meetFn(vector<BitVector> inputs);
+                             map<BasicBlock *, struct bbProps *> anticipated)
+      : StaticDataflow(domainSize, boundaryCond, initCond,
+                       WillBeAvailableTransfer{anticipated, {}}) {}
 };
 }; // namespace llvm
 
-#endif
\ No newline at end of file
+#endif
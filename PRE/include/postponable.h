@@ -1,28 +1,40 @@
 #ifndef __POSTPONABLE_H___
 #define __POSTPONABLE_H___
 
-#include "dataflow.h"
+#include "static-dataflow.h"
 
 using namespace std;
 using namespace llvm;
 
 namespace llvm {
-class PostponableExpressions : public Dataflow {
-private:
+// F(X) = (X U Earliest) - Use
+struct PostponableTransfer {
   map<BasicBlock *, BitVector> earliest;
+  vector<const BitVector *> earliestByIdx; // Earliest, by block number
 
+  static const enum transferShape shape = OR_ANDNOT;
+
+  void prepare(ArrayRef<BasicBlock *> blocks);
+
+  const BitVector &operandA(int idx, const BitVector & /* gen */,
+                            const BitVector & /* kill */) {
+    return *earliestByIdx[idx];
+  }
+  const BitVector &operandB(int /* idx */, const BitVector &gen,
+                            const BitVector & /* kill */) {
+    return gen;
+  }
+};
+
+class PostponableExpressions
+    : public StaticDataflow<FORWARD, IntersectMeet, PostponableTransfer> {
 public:
   PostponableExpressions(int domainSize, BitVector boundaryCond,
                          BitVector initCond,
-                         map<BasicBlock *, BitVector> earliest,
-                         enum passDirection dir = FORWARD)
-      : Dataflow(domainSize, dir, boundaryCond, initCond) {
-    this->earliest = earliest;
-  }
-
-  virtual void transferFn(struct bbProps *props);
-  virtual BitVector meetFn(vector<BitVector> inputs);
+                         map<BasicBlock *, BitVector> earliest)
+      : StaticDataflow(domainSize, boundaryCond, initCond,
+                       PostponableTransfer{earliest, {}}) {}
 };
 } // namespace llvm
 
-#endif
\ No newline at end of file
+#endif
@@ -1,27 +1,39 @@
 #ifndef __USED_H___
 #define __USED_H___
 
-#include "dataflow.h"
+#include "static-dataflow.h"
 
 using namespace std;
 using namespace llvm;
 
 namespace llvm {
-class UsedExpressions : public Dataflow {
-private:
+// F(X) = (X U Use) - Latest
+struct UsedTransfer {
   map<BasicBlock *, BitVector> latest;
+  vector<const BitVector *> latestByIdx; // Latest, by block number
 
-public:
-  UsedExpressions(int domainSize, BitVector boundaryCond, BitVector initCond,
-                  map<BasicBlock *, BitVector> latest,
-                  enum passDirection dir = BACKWARD)
-      : Dataflow(domainSize, dir, boundaryCond, initCond) {
-    this->latest = latest;
+  static const enum transferShape shape = OR_ANDNOT;
+
+  void prepare(ArrayRef<BasicBlock *> blocks);
+
+  const BitVector &operandA(int /* idx */, const BitVector &gen,
+                            const BitVector & /* kill */) {
+    return gen;
   }
+  const BitVector &operandB(int idx, const BitVector & /* gen */,
+                            const BitVector & /* kill */) {
+    return *latestByIdx[idx];
+  }
+};
 
-  virtual void transferFn(struct bbProps *props);
-  virtual BitVector meetFn(vector<BitVector> inputs);
+class UsedExpressions
+    : public StaticDataflow<BACKWARD, UnionMeet, UsedTransfer> {
+public:
+  UsedExpressions(int domainSize, BitVector boundaryCond, BitVector initCond,
+                  map<BasicBlock *, BitVector> latest)
+      : StaticDataflow(domainSize, boundaryCond, initCond,
+                       UsedTransfer{latest, {}}) {}
 };
 } // namespace llvm
 
-#endif
\ No newline at end of file
+#endif
@@ -4,19 +4,10 @@ using namespace llvm;
 using namespace std;
 
 namespace llvm {
-void WillBeAvailableExpressions::transferFn(struct bbProps *props) {
-  BitVector tmp = this->anticipated[props->ref]->bbInput;
-  tmp |= props->bbInput;
-  props->bbOutput = props->killSet.flip();
-  props->bbOutput &= tmp;
-}
-
-BitVector WillBeAvailableExpressions::meetFn(vector<BitVector> inputs) {
-  size_t _sz = inputs.size();
-  BitVector result = inputs[0];
-  for (int itr = 1; itr < _sz; ++itr) {
-    result &= inputs[itr];
+void WillBeAvailableTransfer::prepare(ArrayRef<BasicBlock *> blocks) {
+  anticipatedIn.clear();
+  for (BasicBlock *BB : blocks) {
+    anticipatedIn.push_back(&this->anticipated[BB]->bbInput);
   }
-  return result;
 }
-}; // namespace llvm
\ No newline at end of file
+}; // namespace llvm
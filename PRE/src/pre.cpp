@@ -1,4 +1,5 @@
 #include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
@@ -8,6 +9,8 @@
 
 #include "anticipated.h"
 #include "available.h"
+#include "dom-tree.h"
+#include "pass-stats.h"
 #include "postponable.h"
 #include "pre-support.h"
 #include "used.h"
@@ -17,9 +20,16 @@
 #include <set>
 #include <vector>
 
+#define DEBUG_TYPE "pre"
+
 using namespace llvm;
 using namespace std;
 
+STATISTIC(NumEdgesSplit, "Number of critical edges split");
+STATISTIC(NumInserted, "Number of expressions inserted");
+STATISTIC(NumPhis, "Number of phi nodes inserted");
+STATISTIC(NumReplaced, "Number of redundant expressions replaced");
+
 namespace llvm {
 
 class PRE : public FunctionPass {
@@ -46,6 +56,9 @@ private:
   map<BasicBlock *, BitVector> latest;
   map<BasicBlock *, BitVector> toInsert;
   map<BasicBlock *, BitVector> toReplace;
+  bool converged; // Every analysis reached its fixed point
+  PassStats *stats; // Instrumentation for the current function
+  DomTree domTree;  // Dominator tree, used to place the Phis of temporaries
 
   bool inDomain(Expression);
 
@@ -66,8 +79,7 @@ private:
   void getRedundantOccurences(Function &);
   void lazyCodeMotion(Function &);
 
-  void _TopologicalSortAndReplaceRO(Function &,
-                                    map<BasicBlock *, map<int, Value *>>);
+  void _PlacePhisAndReplaceRO(const map<BasicBlock *, map<int, Value *>> &);
   map<BasicBlock *, map<int, Value *>> _InsertOCP(Function &);
   void printResults(Function &);
   void printBitVector(BitVector);
@@ -81,6 +93,9 @@ static RegisterPass<PRE> Y("pre", "Partial Redundancy Elimination via LCM",
 bool PRE::runOnFunction(Function &F) {
 
   outs() << "Running PRE Pass\n";
+  PassStats passStats("pre", F);
+  this->stats = &passStats;
+
   Init(F);
 
   BitVector empty(domain.size(), false);
@@ -102,12 +117,18 @@ bool PRE::runOnFunction(Function &F) {
 
   getRedundantOccurences(F);
 
+  // Placement computed from results that are not a fixed point is unsafe.
+  if (!converged)
+    return false;
+
   lazyCodeMotion(F);
 
   return false;
 }
 
 void PRE::Init(Function &F) {
+  this->converged = true;
+  domTree.recalculate(F);
   Preprocess(F);
   this->domain = getExpressions(F);
   populateInfoMap(F, this->domain);
@@ -130,10 +151,22 @@ void PRE::Preprocess(Function &F) {
     }
   }
 
+  // Each split replaces the edge with a new block, which is reported to the
+  // dominator tree, so that it does not need to be recalculated.
+  vector<CFGUpdate> updates;
   for (set<pair<BasicBlock *, BasicBlock *>>::iterator itr = toSplit.begin();
        itr != toSplit.end(); ++itr) {
-    SplitEdge((*itr).first, (*itr).second);
+    BasicBlock *pred = (*itr).first, *succ = (*itr).second;
+    BasicBlock *split = SplitEdge(pred, succ);
+    updates.push_back({INSERT_EDGE, pred, split});
+    updates.push_back({INSERT_EDGE, split, succ});
+    // Only one of several edges from pred to succ is split.
+    if (!is_contained(successors(pred), succ))
+      updates.push_back({DELETE_EDGE, pred, succ});
+    ++NumEdgesSplit;
+    stats->addTransform("edges_split");
   }
+  domTree.applyUpdates(updates);
 }
 
 vector<Expression> PRE::getExpressions(Function &F) {
@@ -195,6 +228,8 @@ void PRE::getAnticipated(Function &F, BitVector empty, BitVector full) {
 
   antPass->run(F, infoMap);
   this->anticipated = antPass->result;
+  this->converged &= antPass->hasConverged();
+  this->stats->addAnalysis(*antPass);
 }
 
 void PRE::getWillBeAvailable(Function &F, BitVector empty, BitVector full) {
@@ -204,6 +239,8 @@ void PRE::getWillBeAvailable(Function &F, BitVector empty, BitVector full) {
   wbaPass->run(F, infoMap);
 
   this->available = wbaPass->result;
+  this->converged &= wbaPass->hasConverged();
+  this->stats->addAnalysis(*wbaPass);
 }
 
 void PRE::getEarliest(Function &F) {
@@ -221,10 +258,17 @@ void PRE::getPostponable(Function &F, BitVector empty, BitVector full) {
   postPass->run(F, infoMap);
 
   this->postponable = postPass->result;
+  this->converged &= postPass->hasConverged();
+  this->stats->addAnalysis(*postPass);
 }
 
 void PRE::getLatest(Function &F) {
   for (BasicBlock &BB : F) {
+    // Nothing is computed in unreachable blocks, which have no block info.
+    if (!this->infoMap.count(&BB)) {
+      this->latest[&BB] = BitVector(domain.size(), false);
+      continue;
+    }
     BitVector earliestExp = this->earliest[&BB];
     BitVector postExp = this->postponable[&BB]->bbInput;
     BitVector tmp = earliestExp;
@@ -252,6 +296,8 @@ void PRE::getUsed(Function &F, BitVector empty, BitVector full) {
   usedPass->run(F, infoMap);
 
   this->used = usedPass->result;
+  this->converged &= usedPass->hasConverged();
+  this->stats->addAnalysis(*usedPass);
 }
 
 void PRE::getOptimalComputationPoints(Function &F) {
@@ -264,6 +310,10 @@ void PRE::getOptimalComputationPoints(Function &F) {
 
 void PRE::getRedundantOccurences(Function &F) {
   for (BasicBlock &BB : F) {
+    if (!this->infoMap.count(&BB)) {
+      this->toReplace[&BB] = BitVector(domain.size(), false);
+      continue;
+    }
     BitVector tmp = this->latest[&BB].flip();
     tmp |= this->used[&BB]->bbOutput;
     tmp &= this->infoMap[&BB]->genSet;
@@ -287,143 +337,213 @@ map<BasicBlock *, map<int, Value *>> PRE::_InsertOCP(Function &F) {
                                    &*(BB.getFirstInsertionPt()));
 
         _inserted[&BB][i] = bop;
+        ++NumInserted;
+        stats->addTransform("inserted");
       }
   }
 
   return _inserted;
 }
 
-void PRE::_TopologicalSortAndReplaceRO(
-    Function &F, map<BasicBlock *, map<int, Value *>> inserted) {
-
-  /**
-   * @brief This variable stores reaching definitions of temporary variables.
-   * This helps us join multiple temporaries for the same expression at their
-   * dominance frontier(DF+).
-   * The structure of this map is as follows:
-   * map<BasicBlock,
-   *       map<index in domain (Represents an Expression),
-   *             vector<pair<Definition of Temporary Variable,
-   *                         BasicBlock from which definition is reaching>>>>
-   *
-   */
-  map<BasicBlock *, map<int, vector<pair<Value *, BasicBlock *>>>> _state;
-
-  queue<BasicBlock *> Q;
-
-  map<BasicBlock *, int> inDeg; // In-degrees for each BasicBlock in the CFG
-
-  // Calculate in-degrees. For BasicBlock BB, in-degree[BB] = count of
-  // predecessors of BB
-  for (BasicBlock &BB : F) {
-    int preds = 0;
-    for (BasicBlock *pred : predecessors(&BB)) {
-      preds++;
+/* Connects the temporaries inserted at the optimal computation points to the
+ * redundant occurrences they replace, the same way SSA construction connects
+ * definitions to uses. For each expression, a Phi instruction is placed at the
+ * iterated dominance frontier (DF+) of the blocks where its temporary was
+ * inserted, since those are the only blocks where different temporaries can
+ * meet. The dominator tree is then walked from the entry block, tracking the
+ * temporary that reaches each point for every expression. It replaces the
+ * redundant occurrences, and becomes the incoming value of the Phis in each
+ * successor. Finally, Phis that do not feed any replaced occurrence are
+ * removed again.
+ */
+void PRE::_PlacePhisAndReplaceRO(
+    const map<BasicBlock *, map<int, Value *>> &inserted) {
+  int numBlocks = domTree.size();
+  int domainSize = domain.size();
+
+  // Blocks in which a temporary was inserted, and the type of the temporary,
+  // for each Expression in the domain.
+  vector<SmallVector<int, 4>> defBlocks(domainSize);
+  vector<Type *> types(domainSize, nullptr);
+  for (auto &blockTemps : inserted) {
+    int id = domTree.getBlockId(blockTemps.first);
+    if (id == -1)
+      continue;
+    for (auto &temp : blockTemps.second) {
+      defBlocks[temp.first].push_back(id);
+      types[temp.first] = temp.second->getType();
     }
-    inDeg[&BB] = preds;
   }
 
-  // Start Toplogical Sort
-  Q.push(&F.getEntryBlock());
-
-  while (Q.size() > 0) {
-
-    BasicBlock &currBlock = *Q.front();
-    Q.pop();
-
-    /* For each Temporary variable inserted in the BasicBlock, update State.
-     * i.first refers to the index of the Expression in the domain BitVector.
-     * i.second refers to the inserted Temporary value.
-     */
-    for (auto &i : inserted[&currBlock]) {
-      _state[&currBlock][i.first].push_back(make_pair(i.second, &currBlock));
+  // Place an empty Phi for each Expression at DF+ of its temporaries. The
+  // Phis are placed after any existing Phi, and before the temporaries.
+  vector<vector<pair<int, PHINode *>>> phis(numBlocks);
+  vector<PHINode *> placed;
+  for (int i = 0; i < domainSize; ++i) {
+    if (defBlocks[i].empty())
+      continue;
+    SmallVector<int, 8> idf;
+    domTree.iteratedFrontier(defBlocks[i], idf);
+    for (int id : idf) {
+      BasicBlock *BB = domTree.getBlock(id);
+      PHINode *phiNode = PHINode::Create(types[i], pred_size(BB), Twine(),
+                                         BB->getFirstNonPHI());
+      phis[id].push_back(make_pair(i, phiNode));
+      placed.push_back(phiNode);
     }
+  }
 
-    map<int, Value *>
-        replaceWith; // Mapping of each Expression index in the domain, to the
-                     // Value it needs to be replaced with in the current block.
-
-    for (int i = 0; i < domainToBitMap.size();
-         ++i) { // For each Expression in Domain
-
-      if (_state[&currBlock][i].size() > 0) {
-        Value *value;
-
-        // For a given Expression represented by i, check if definitions from
-        // multiple values reach this block.
-        if (_state[&currBlock][i].size() > 1) {
-
-          // If multiple definitions for an Expression is reaching the current
-          // block, create a Phi Node and join the conflicting definitions.
-          PHINode *phiNode =
-              PHINode::Create(_state[&currBlock][i][0].first->getType(),
-                              _state[&currBlock][i].size(), Twine(),
-                              currBlock.getFirstNonPHI());
-
-          for (int j = 0; j < _state[&currBlock][i].size(); ++j) {
-            phiNode->addIncoming(_state[&currBlock][i][j].first,
-                                 _state[&currBlock][i][j].second);
-          }
-          // When we look for Expressions to replace with, we will use this Phi
-          // Instruction
-          value = phiNode;
-        } else {
-          value = _state[&currBlock][i][0].first;
+  // Temporary reaching the current point of the walk, for each Expression,
+  // and the values it replaced, to be restored when the walk leaves a
+  // subtree.
+  vector<Value *> reaching(domainSize, nullptr);
+  vector<pair<int, Value *>> undo;
+
+  // Pre-order walk of the dominator tree. Each frame holds a block, the
+  // position in its list of children, and the size of the undo log on entry.
+  struct frame {
+    int id;
+    int child;
+    size_t mark;
+  };
+  vector<frame> stack;
+  stack.push_back({0, 0, 0});
+  bool entering = true;
+
+  while (!stack.empty()) {
+    frame &top = stack.back();
+    BasicBlock &currBlock = *domTree.getBlock(top.id);
+
+    if (entering) {
+      top.mark = undo.size();
+
+      // Phis and temporaries at the top of the block define new values.
+      for (auto &phi : phis[top.id]) {
+        undo.push_back(make_pair(phi.first, reaching[phi.first]));
+        reaching[phi.first] = phi.second;
+      }
+      auto temps = inserted.find(&currBlock);
+      if (temps != inserted.end()) {
+        for (auto &temp : temps->second) {
+          undo.push_back(make_pair(temp.first, reaching[temp.first]));
+          reaching[temp.first] = temp.second;
         }
-        replaceWith[i] = value;
       }
-    }
 
-    // Check if there are Expressions that are Redundant Occurences and thus
-    // need to be replaced.
-    for (auto it = currBlock.begin(); it != currBlock.end(); ) {
-      Instruction &I = *it;
-      ++it;
-      if (I.isBinaryOp()) {
-        if (find(domain.begin(), domain.end(), Expression(&I)) == domain.end())
+      // Check if there are Expressions that are Redundant Occurences and thus
+      // need to be replaced.
+      for (auto it = currBlock.begin(); it != currBlock.end();) {
+        Instruction &I = *it;
+        ++it;
+        if (!I.isBinaryOp())
+          continue;
+        auto exp = domainToBitMap.find(Expression(&I));
+        if (exp == domainToBitMap.end())
           continue;
-        Expression exp = Expression(&I);
-        int index = domainToBitMap[exp];
+        int index = exp->second;
 
         // toReplace represents the BitVector representation of Redundant
-        // Occurences
-        if (this->toReplace[&currBlock][domainToBitMap[exp]]) {
-          if (replaceWith.find(index) != replaceWith.end()) {
-            // If the Instruction itself is the Temporary Instruction, we skip
-            // an iteration
-            if (replaceWith[index] == &I)
-              continue;
-
-            BasicBlock::iterator at(&I);
-            ReplaceInstWithValue(currBlock.getInstList(), at,
-                                 replaceWith[index]);
-          }
+        // Occurences. If the Instruction itself is the Temporary Instruction,
+        // there is nothing to replace.
+        if (this->toReplace[&currBlock][index] && reaching[index] &&
+            reaching[index] != &I) {
+          BasicBlock::iterator at(&I);
+          ReplaceInstWithValue(currBlock.getInstList(), at, reaching[index]);
+          ++NumReplaced;
+          stats->addTransform("replaced");
+        }
+      }
+
+      // Feed the temporaries reaching the end of the block into the Phis of
+      // its successors, one incoming value per edge.
+      for (BasicBlock *next : successors(&currBlock)) {
+        for (auto &phi : phis[domTree.getBlockId(next)]) {
+          Value *value = reaching[phi.first];
+          if (!value)
+            value = UndefValue::get(types[phi.first]);
+          phi.second->addIncoming(value, &currBlock);
         }
       }
     }
 
-    for (BasicBlock *next : successors(&currBlock)) {
-      // We have visted the current block, therefore, we reduce the in-degree of
-      // its successors. If the in-degree becomes 0 for any successor, we add it
-      // to Topological Sort queue. This ensures that we don't visit a node
-      // without visiting all its predecessors first.
-      if ((--inDeg[next]) == 0) {
-        Q.push(next);
+    ArrayRef<int> children = domTree.children(top.id);
+    if (top.child < (int)children.size()) {
+      int child = children[top.child++];
+      stack.push_back({child, 0, 0});
+      entering = true;
+      continue;
+    }
+
+    // Leaving the subtree of this block.
+    while (undo.size() > top.mark) {
+      reaching[undo.back().first] = undo.back().second;
+      undo.pop_back();
+    }
+    stack.pop_back();
+    entering = false;
+  }
+
+  // The walk only feeds the edges from reachable blocks. A Phi still needs an
+  // incoming value for every other predecessor, and no temporary reaches it
+  // along those edges.
+  for (int id = 0; id < numBlocks; ++id) {
+    if (phis[id].empty())
+      continue;
+    BasicBlock *BB = domTree.getBlock(id);
+    for (BasicBlock *pred : predecessors(BB)) {
+      if (domTree.isReachable(pred))
+        continue;
+      for (auto &phi : phis[id]) {
+        phi.second->addIncoming(UndefValue::get(types[phi.first]), pred);
       }
+    }
+  }
 
-      // Propagate the definition of Temporary variable inserted, to all the successors.
-      for (int i = 0; i < domainToBitMap.size(); ++i) {
-        if (replaceWith.find(i) != replaceWith.end()) {
-          _state[next][i].push_back(make_pair(replaceWith[i], &currBlock));
-        }
+  // A placed Phi is needed if it is used by a replaced occurrence, or by
+  // another needed Phi. The others only merge temporaries that are never used.
+  set<PHINode *> isPlaced(placed.begin(), placed.end());
+  set<PHINode *> needed;
+  vector<PHINode *> worklist;
+  for (PHINode *phiNode : placed) {
+    for (User *U : phiNode->users()) {
+      PHINode *userPhi = dyn_cast<PHINode>(U);
+      if (!userPhi || !isPlaced.count(userPhi)) {
+        needed.insert(phiNode);
+        worklist.push_back(phiNode);
+        break;
+      }
+    }
+  }
+  while (!worklist.empty()) {
+    PHINode *phiNode = worklist.back();
+    worklist.pop_back();
+    for (Value *incoming : phiNode->incoming_values()) {
+      PHINode *incomingPhi = dyn_cast<PHINode>(incoming);
+      if (incomingPhi && isPlaced.count(incomingPhi) &&
+          needed.insert(incomingPhi).second) {
+        worklist.push_back(incomingPhi);
       }
     }
   }
+
+  for (PHINode *phiNode : placed) {
+    if (!needed.count(phiNode))
+      phiNode->replaceAllUsesWith(UndefValue::get(phiNode->getType()));
+  }
+  for (PHINode *phiNode : placed) {
+    if (needed.count(phiNode)) {
+      ++NumPhis;
+      stats->addTransform("phis_inserted");
+    } else {
+      phiNode->eraseFromParent();
+    }
+  }
 }
+
 void PRE::lazyCodeMotion(Function &F) {
 
   map<BasicBlock *, map<int, Value *>> _inserted = _InsertOCP(F);
-  _TopologicalSortAndReplaceRO(F, _inserted);
+  _PlacePhisAndReplaceRO(_inserted);
 }
 
 void PRE::printResults(Function &F) {
@@ -0,0 +1,35 @@
+; a + b is partially redundant at %j, whose predecessors include a block that
+; is unreachable. The Phi merging the temporaries needs an incoming value for
+; that edge too.
+
+; CHECK-LABEL: define i32 @f(
+; CHECK: j:
+; CHECK-NEXT: %y = phi i32 {{.*}}[ undef, %dead.split ]
+; CHECK-NEXT: ret i32 %y
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+
+define i32 @f(i32 %a, i32 %b, i1 %c) {
+entry:
+  br i1 %c, label %l, label %r
+l:
+  %x = add i32 %a, %b
+  br label %j
+r:
+  br label %j
+dead:
+  br label %j
+j:
+  %y = add i32 %a, %b
+  ret i32 %y
+}
+
+define i32 @main() {
+  %p = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  %r1 = call i32 @f(i32 3, i32 4, i1 true)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r1)
+  %r2 = call i32 @f(i32 5, i32 -9, i1 false)
+  call i32 (i8*, ...) @printf(i8* %p, i32 %r2)
+  ret i32 0
+}